@@ -107,9 +107,11 @@
 #define ALIGNMENT 8
 
 /*
- * Maximum heap size in bytes
+ * Maximum heap size in bytes; override with -DMAX_HEAP=... (up to 8 GB)
  */
-#define MAX_HEAP (100*(1<<20))  /* 100 MB */
+#ifndef MAX_HEAP
+#define MAX_HEAP (100ULL*(1<<20))  /* 100 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
@@ -64,9 +64,10 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
+    enum { ALLOC, FREE, REALLOC, MEMALIGN } type; /* type of request */
     int index;                        /* index for free() to use later */
     size_t size;                      /* byte size of alloc/realloc request */
+    size_t alignment;                 /* boundary of a memalign request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -245,7 +246,8 @@ static void run_tests(int num_tracefiles, const char *tracedir,
 
         free_trace(trace);
 
-        /* clean up memory system */
+        /* clean up memory system, once no free is still in flight */
+        mm_flush();
         mem_deinit();
     }
 }
@@ -268,6 +270,10 @@ int main(int argc, char **argv)
     int run_libc = 0;     /* If set, run libc malloc (set by -l) */
     int autograder = 0;   /* if set then called by autograder (-A) */
 
+    enum mm_fit fit = MM_FIT_FIRST;       /* placement policy (-p) */
+    enum mm_order order = MM_ORDER_LIFO;  /* free list order (-a) */
+    unsigned int probes = 8;              /* good-fit probe limit (-k) */
+
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput = 0, p1, p2, perfindex;
     double util_weight = 0, perf_weight = 0;
@@ -280,7 +286,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:p:k:hVAlDa")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -338,6 +344,29 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'p': /* Placement policy */
+            if (strcmp(optarg, "first") == 0)
+                fit = MM_FIT_FIRST;
+            else if (strcmp(optarg, "next") == 0)
+                fit = MM_FIT_NEXT;
+            else if (strcmp(optarg, "best") == 0)
+                fit = MM_FIT_BEST;
+            else if (strcmp(optarg, "good") == 0)
+                fit = MM_FIT_GOOD;
+            else {
+                usage();
+                exit(1);
+            }
+            break;
+
+        case 'k': /* Probe limit for good fit */
+            probes = atoi(optarg);
+            break;
+
+        case 'a': /* Address-ordered free lists */
+            order = MM_ORDER_ADDRESS;
+            break;
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -358,6 +387,9 @@ int main(int argc, char **argv)
         init_random_data();
     }
 
+    /* Every mm_init from here on uses the selected placement policy */
+    mm_set_policy(fit, order, probes);
+
     /* Initialize the timing package */
     init_fsecs();
 
@@ -420,7 +452,8 @@ int main(int argc, char **argv)
     /* Display the mm results in a compact table */
     if (verbose) {
         if (onetime_flag) {
-            printf("\n\ncorrectness check finished, by running tracefile \"%s\".\n", tracefiles[num_tracefiles-1]);
+            printf("\n\ncorrectness check finished, by running tracefile "
+                   "\"%s\".\n", tracefiles[num_tracefiles-1]);
             if (mm_stats[num_tracefiles-1].valid) {
                 printf(" => correct.\n\n");
             } else {
@@ -515,7 +548,8 @@ int main(int argc, char **argv)
         } else if (avg_mm_throughput > MAX_SPEED) {
             p2 = 1.0 - UTIL_WEIGHT;
         } else {
-            p2 = (avg_mm_throughput - MIN_SPEED) / (MAX_SPEED - MIN_SPEED) * (1.0 - UTIL_WEIGHT);
+            p2 = (avg_mm_throughput - MIN_SPEED) / (MAX_SPEED - MIN_SPEED) *
+                 (1.0 - UTIL_WEIGHT);
         }
 
         perfindex = (p1 + p2)*100.0;
@@ -572,15 +606,25 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or within
+       one of the separate mappings that memlib handed out */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+        mem_mapped_range(lo, hi) == 0) {
         malloc_error(trace, opnum,
                      "Payload (%p:%p) lies outside heap (%p:%p)",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
         return 0;
     }
 
+    /* The allocator must report at least as many usable bytes as asked for */
+    if (mm_usable_size(lo) < (size_t)size) {
+        malloc_error(trace, opnum,
+                     "mm_usable_size(%p) is %zu, less than the %d bytes "
+                     "requested", lo, mm_usable_size(lo), size);
+        return 0;
+    }
+
     /* If we can't afford the linear-time loop, we check less thoroughly and
        just assume the overlap will be caught by writing random bits. */
     if(trace->ignore_ranges || debug_mode == DBG_NONE) return 1;
@@ -720,7 +764,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     FILE *tracefile;
     trace_t *trace;
     char type[MAXLINE];
-    int index, size;
+    int index, size, alignment;
     int max_index = 0;
     int op_index;
 
@@ -789,6 +833,14 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
             trace->ops[op_index].size = size;
             max_index = (index > max_index) ? index : max_index;
             break;
+        case 'm':
+            fscanf(tracefile, "%d %d %d", &index, &size, &alignment);
+            trace->ops[op_index].type = MEMALIGN;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            trace->ops[op_index].alignment = alignment;
+            max_index = (index > max_index) ? index : max_index;
+            break;
         case 'f':
             fscanf(tracefile, "%d", &index);
             trace->ops[op_index].type = FREE;
@@ -853,7 +905,9 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
     char *oldp;
     char *p;
 
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and free any records in the range list, once frees
+       still in flight from the last run have landed */
+    mm_flush();
     mem_reset_brk();
     clear_ranges(ranges);
     reinit_trace(trace);
@@ -909,6 +963,31 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             randomize_block(trace, index);
             break;
 
+        case MEMALIGN: /* mm_memalign */
+            check_index(trace, i, index);
+
+            /* Call the student's memalign */
+            if ((p = mm_memalign(trace->ops[i].alignment, size)) == NULL) {
+                malloc_error(trace, i, "mm_memalign failed.");
+                return 0;
+            }
+
+            /* The payload must also start on the requested boundary */
+            if ((unsigned long)p % trace->ops[i].alignment != 0) {
+                malloc_error(trace, i,
+                             "Payload address (%p) not aligned to %zu bytes",
+                             p, trace->ops[i].alignment);
+                return 0;
+            }
+
+            if (add_range(ranges, p, size, trace, i, index) == 0)
+                return 0;
+
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            randomize_block(trace, index);
+            break;
+
         case REALLOC: /* mm_realloc */
             check_index(trace, i, index);
 
@@ -977,10 +1056,10 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   peak size of the heap in bytes while running the student's malloc
+ *   package on the trace. mem_sbrk() lets the package decrement the
+ *   brk pointer, so we ask memlib for the high water mark of the brk
+ *   rather than its final value.
  *
  *   A higher number is better: 1 is optimal.
  */
@@ -997,6 +1076,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
     reinit_trace(trace);
 
     /* initialize the heap and the mm malloc package */
+    mm_flush();
     mem_reset_brk();
     if (mm_init() < 0)
         app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
@@ -1020,6 +1100,21 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             total_size += size;
             break;
 
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+
+            if ((p = mm_memalign(trace->ops[i].alignment, size)) == NULL) {
+                app_error("trace %d: mm_memalign failed in eval_mm_util",
+                          tracenum);
+            }
+
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+
+            total_size += size;
+            break;
+
         case REALLOC: /* mm_realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -1065,7 +1160,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 
     printf(".");
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
 
@@ -1081,6 +1176,7 @@ static void eval_mm_speed(void *ptr)
     reinit_trace(trace);
 
     /* Reset the heap and initialize the mm package */
+    mm_flush();
     mem_reset_brk();
     if (mm_init() < 0)
         app_error("mm_init failed in eval_mm_speed");
@@ -1097,6 +1193,14 @@ static void eval_mm_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].alignment, size)) == NULL)
+                app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
         case REALLOC: /* mm_realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -1145,6 +1249,15 @@ static int eval_libc_valid(trace_t *trace)
             trace->blocks[trace->ops[i].index] = p;
             break;
 
+        case MEMALIGN: /* posix_memalign */
+            if (posix_memalign((void **)&p, trace->ops[i].alignment,
+                               trace->ops[i].size) != 0) {
+                malloc_error(trace, i, "libc posix_memalign failed");
+                unix_error("System message");
+            }
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
         case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
             oldp = trace->blocks[trace->ops[i].index];
@@ -1195,6 +1308,14 @@ static void eval_libc_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case MEMALIGN: /* posix_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if (posix_memalign((void **)&p, trace->ops[i].alignment, size) != 0)
+                unix_error("posix_memalign failed in eval_libc_speed");
+            trace->blocks[index] = p;
+            break;
+
         case REALLOC: /* realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -1375,11 +1496,13 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlVdDa] [-f <file>] [-p <fit>] "
+                    "[-k <n>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
-    fprintf(stderr, "\t-c <file>  Run trace file <file> once, check for correctness only.\n");
+    fprintf(stderr, "\t-c <file>  Run trace file <file> once, check for "
+                    "correctness only.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
@@ -1387,4 +1510,10 @@ static void usage(void)
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-p <fit>   Placement: first (default), next, best "
+                    "or good.\n");
+    fprintf(stderr, "\t-k <n>     Good fit stops after <n> probes "
+                    "(default 8).\n");
+    fprintf(stderr, "\t-a         Keep free lists in address order "
+                    "instead of LIFO.\n");
 }
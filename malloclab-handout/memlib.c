@@ -3,6 +3,7 @@
  *						allows us to interleave calls from the student's malloc package
  *						with the system's malloc package in libc.
  */
+#define _GNU_SOURCE		/* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -13,14 +14,73 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* most separate mappings (see mem_map) that may be live at once */
+#define MEM_MAX_MAPS 4096
+
+/* most extra break regions (see mem_region_new) */
+#define MEM_MAX_REGIONS 64
+
 /* private variables */
 static char *heap;
 static char *mem_brk;
 static char *mem_max_addr;
+static size_t mem_peak;		/* largest heap plus mapped bytes since reset */
+
+/* the reservation is mapped from /dev/zero, and what no break has reached
+   since mem_init still reads as zero: the main break's highest reach and
+   the lowest byte any region has handed out bound it (see mem_zeroed);
+   the real break has been moved as far as that highest reach */
+static char *mem_touched_lo;
+static char *mem_touched_hi;
+
+/* serializes the calls that move a break or change the mappings, which
+   threads of a -DARENAS build make concurrently */
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* live mappings handed out by mem_map */
+static struct {
+	char *lo;
+	size_t size;
+} mem_maps[MEM_MAX_MAPS];
+static int mem_nmaps;
+static size_t mem_mapped;		/* total bytes in mem_maps */
+
+/* extra break regions carved off the top of the reservation; region 0
+   is the main heap, so mem_regions[0] is unused */
+static struct {
+	char *lo;
+	char *brk;
+	char *max;
+} mem_regions[MEM_MAX_REGIONS + 1];
+static int mem_nregions;
+static size_t mem_region_bytes;	/* bytes below the breaks of regions 1.. */
+
+/*
+ * mem_update_peak - remember the largest footprint seen so far
+ */
+static void mem_update_peak(void) {
+	size_t footprint = (size_t)(mem_brk - heap) + mem_mapped +
+	                   mem_region_bytes;
+
+	if (footprint > mem_peak)
+		mem_peak = footprint;
+}
+
+/*
+ * mem_unmap_all - release every mapping still handed out
+ */
+static void mem_unmap_all(void) {
+	while (mem_nmaps > 0) {
+		mem_nmaps--;
+		munmap(mem_maps[mem_nmaps].lo, mem_maps[mem_nmaps].size);
+	}
+	mem_mapped = 0;
+}
 
 /*
  * mem_init - initialize the memory system model
@@ -30,11 +90,18 @@ void mem_init(void){
 	heap = mmap((void *)0x800000000, /* suggested start*/
 			MAX_HEAP,				/* length */
 			PROT_WRITE,				/* permissions */
-			MAP_PRIVATE,			/* private or shared? */
+			MAP_PRIVATE | MAP_NORESERVE,	/* private, committed lazily */
 			dev_zero,				/* fd */
 			0);						/* offset (dunno) */
 	mem_max_addr = heap + MAX_HEAP;
 	mem_brk = heap;					/* heap is empty initially */
+	mem_touched_lo = heap;
+	mem_touched_hi = heap + MAX_HEAP;
+	mem_peak = 0;
+	mem_nmaps = 0;
+	mem_mapped = 0;
+	mem_nregions = 0;
+	mem_region_bytes = 0;
 }
 
 /*
@@ -42,35 +109,255 @@ void mem_init(void){
  */
 void mem_deinit(void){
 	munmap(heap, MAX_HEAP);
+	mem_unmap_all();
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *		releasing any separate mappings and extra regions as well
  */
 void mem_reset_brk(){
 	mem_brk = heap;
+	mem_max_addr = heap + MAX_HEAP;
+	mem_nregions = 0;
+	mem_region_bytes = 0;
+	mem_unmap_all();
+	mem_peak = 0;
 }
 
 /*
- * mem_sbrk - simple model of the sbrk function. Extends the heap
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ * mem_brk_move - move the break of the main heap; mem_lock must be held
  */
-void *mem_sbrk(int incr) {
+static void *mem_brk_move(intptr_t incr) {
 	char *old_brk = mem_brk;
 
+	if (incr < 0) {
+		if (-incr > mem_brk - heap) {
+			errno = EINVAL;
+			fprintf(stderr, "ERROR: mem_sbrk failed. Shrank below the heap...\n");
+			return (void *)-1;
+		}
+
+		// the real break may have moved since, so it is left alone
+		mem_brk += incr;
+		return (void *)old_brk;
+	}
+
     // call sbrk() in an attempt to have similar semantics as a real allocator.
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ||
-            sbrk(incr) == (void *) -1) {
+	// The real break already covers the main break's highest reach, so
+	// only growth past it moves the real one.
+	if ( (incr > mem_max_addr - mem_brk) ||
+	    (mem_brk + incr > mem_touched_lo &&
+	     sbrk(mem_brk + incr - mem_touched_lo) == (void *) -1)) {
 		errno = ENOMEM;
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 		return (void *)-1;
 	}
 
 	mem_brk += incr;
+	if (mem_brk > mem_touched_lo)
+		mem_touched_lo = mem_brk;
+	mem_update_peak();
 	return (void *)old_brk;
 }
 
+/*
+ * mem_sbrk - simple model of the sbrk function. Extends the heap
+ *		by incr bytes and returns the start address of the new area. A
+ *		negative incr shrinks the heap and returns the old break.
+ */
+void *mem_sbrk(intptr_t incr) {
+	void *old_brk;
+
+	pthread_mutex_lock(&mem_lock);
+	old_brk = mem_brk_move(incr);
+	pthread_mutex_unlock(&mem_lock);
+	return old_brk;
+}
+
+/*
+ * mem_region_new - carve size bytes (rounded up to whole pages) off the top
+ *		of the reservation as a region with a break of its own, and
+ *		return its number for mem_region_sbrk, or -1 if the main heap
+ *		already reaches that far.  Regions are handed out top down in
+ *		order, and the main heap can no longer grow into them.
+ */
+int mem_region_new(size_t size) {
+	int region = -1;
+
+	size = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+	pthread_mutex_lock(&mem_lock);
+
+	if (mem_nregions == MEM_MAX_REGIONS ||
+	    size > (size_t)(mem_max_addr - mem_brk)) {
+		errno = ENOMEM;
+	} else {
+		region = ++mem_nregions;
+		mem_regions[region].max = mem_max_addr;
+		mem_max_addr -= size;
+		mem_regions[region].lo = mem_max_addr;
+		mem_regions[region].brk = mem_max_addr;
+	}
+
+	pthread_mutex_unlock(&mem_lock);
+	return region;
+}
+
+/*
+ * mem_region_sbrk - mem_sbrk for a region from mem_region_new; region 0
+ *		is the main heap
+ */
+void *mem_region_sbrk(int region, intptr_t incr) {
+	char *old_brk;
+
+	if (region == 0)
+		return mem_sbrk(incr);
+
+	pthread_mutex_lock(&mem_lock);
+	old_brk = mem_regions[region].brk;
+
+	if (incr < 0 ? -incr > old_brk - mem_regions[region].lo :
+	               incr > mem_regions[region].max - old_brk) {
+		pthread_mutex_unlock(&mem_lock);
+		errno = ENOMEM;
+		fprintf(stderr, "ERROR: mem_region_sbrk failed on region %d...\n",
+		        region);
+		return (void *)-1;
+	}
+
+	mem_regions[region].brk += incr;
+	mem_region_bytes += incr;
+	if (incr > 0 && old_brk < mem_touched_hi)
+		mem_touched_hi = old_brk;
+	mem_update_peak();
+	pthread_mutex_unlock(&mem_lock);
+	return (void *)old_brk;
+}
+
+/*
+ * mem_map - model of an anonymous mmap outside the heap. Returns a
+ *		page-aligned region of size bytes (rounded up to whole pages),
+ *		or NULL if it cannot be mapped.
+ */
+void *mem_map(size_t size) {
+	char *lo;
+
+	size = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+	pthread_mutex_lock(&mem_lock);
+
+	if (mem_nmaps == MEM_MAX_MAPS ||
+	    (lo = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		pthread_mutex_unlock(&mem_lock);
+		errno = ENOMEM;
+		fprintf(stderr, "ERROR: mem_map failed. Ran out of memory...\n");
+		return NULL;
+	}
+
+	mem_maps[mem_nmaps].lo = lo;
+	mem_maps[mem_nmaps].size = size;
+	mem_nmaps++;
+	mem_mapped += size;
+	mem_update_peak();
+	pthread_mutex_unlock(&mem_lock);
+	return lo;
+}
+
+/*
+ * mem_unmap - release a region returned by mem_map
+ */
+void mem_unmap(void *lo) {
+	int i;
+
+	pthread_mutex_lock(&mem_lock);
+
+	for (i = 0; i < mem_nmaps; i++) {
+		if (mem_maps[i].lo == lo) {
+			munmap(lo, mem_maps[i].size);
+			mem_mapped -= mem_maps[i].size;
+			mem_maps[i] = mem_maps[--mem_nmaps];
+			pthread_mutex_unlock(&mem_lock);
+			return;
+		}
+	}
+
+	pthread_mutex_unlock(&mem_lock);
+	fprintf(stderr, "ERROR: mem_unmap of unknown region %p\n", lo);
+}
+
+/*
+ * mem_remap - resize a region returned by mem_map to size bytes (rounded
+ *		up to whole pages), letting the kernel move its pages rather
+ *		than copy them. Returns its new start, or NULL, leaving the
+ *		region as it was, if it cannot be resized.
+ */
+void *mem_remap(void *lo, size_t size) {
+#ifdef MREMAP_MAYMOVE
+	char *newlo;
+	int i;
+
+	size = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+	pthread_mutex_lock(&mem_lock);
+
+	for (i = 0; i < mem_nmaps; i++) {
+		if (mem_maps[i].lo == lo) {
+			if ((newlo = mremap(lo, mem_maps[i].size, size,
+			                    MREMAP_MAYMOVE)) == MAP_FAILED) {
+				pthread_mutex_unlock(&mem_lock);
+				errno = ENOMEM;
+				return NULL;
+			}
+			mem_mapped = mem_mapped - mem_maps[i].size + size;
+			mem_maps[i].lo = newlo;
+			mem_maps[i].size = size;
+			mem_update_peak();
+			pthread_mutex_unlock(&mem_lock);
+			return newlo;
+		}
+	}
+
+	pthread_mutex_unlock(&mem_lock);
+	fprintf(stderr, "ERROR: mem_remap of unknown region %p\n", lo);
+#else
+	(void)lo;
+	(void)size;
+#endif
+	return NULL;
+}
+
+/*
+ * mem_mapped_range - return the size of the mapping that holds the
+ *		bytes lo..hi, or 0 if no single mapping does
+ */
+size_t mem_mapped_range(const void *lo, const void *hi) {
+	int i;
+
+	for (i = 0; i < mem_nmaps; i++) {
+		if ((const char *)lo >= mem_maps[i].lo &&
+		    (const char *)hi < mem_maps[i].lo + mem_maps[i].size)
+			return mem_maps[i].size;
+	}
+
+	return 0;
+}
+
+/*
+ * mem_zeroed - return whether the size bytes at lo have not been handed
+ *		out by any break since mem_init, so that they still read as
+ *		zero.  Unlike a real break, one moved back down (or reset)
+ *		leaves the old contents in place.
+ */
+int mem_zeroed(const void *lo, size_t size) {
+	int zeroed;
+
+	pthread_mutex_lock(&mem_lock);
+	zeroed = (const char *)lo >= mem_touched_lo &&
+	         (const char *)lo <= mem_touched_hi &&
+	         size <= (size_t)(mem_touched_hi - (const char *)lo);
+	pthread_mutex_unlock(&mem_lock);
+	return zeroed;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -92,6 +379,15 @@ size_t mem_heapsize() {
 	return (size_t)((uintptr_t)mem_brk - (uintptr_t)heap);
 }
 
+/*
+ * mem_peak_heapsize() - returns the largest number of bytes held in the
+ *		heap, its extra regions and separate mappings together since the
+ *		heap was last reset
+ */
+size_t mem_peak_heapsize() {
+	return mem_peak;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
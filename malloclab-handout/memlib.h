@@ -1,11 +1,20 @@
 #include <unistd.h>
+#include <stdint.h>
 
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
+int mem_region_new(size_t size);
+void *mem_region_sbrk(int region, intptr_t incr);
+void *mem_map(size_t size);
+void mem_unmap(void *lo);
+void *mem_remap(void *lo, size_t size);
+size_t mem_mapped_range(const void *lo, const void *hi);
+int mem_zeroed(const void *lo, size_t size);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
 
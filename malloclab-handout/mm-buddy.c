@@ -0,0 +1,1254 @@
+/*
+ * mm-buddy.c
+ * hbovik - Harry Bovik
+ *
+ * Binary buddy allocator, an alternative engine to mm.c (build it with
+ * "make MM=mm-buddy").
+ *
+ * Every block is 2^order bytes and starts at an offset from heap_base that
+ * is a multiple of its own size, so the buddy it was split from (and will
+ * merge back with) sits at the offset with bit order flipped.  A block
+ * begins with a one-word header holding its order and an allocated bit;
+ * the payload starts BUDDY_HEADER bytes in, which keeps it 8-byte aligned.
+ * No block needs a footer: free looks its buddy up by address, and the
+ * two merge when the buddy is free and of the same order.
+ *
+ * memalign takes a block large enough to slide the payload up to the
+ * boundary.  The word in front of such a payload holds OFFSETBIT and its
+ * distance past the block's header, which mem_block follows back.
+ *
+ * Free blocks sit on one doubly-linked list per order, with the links in
+ * the first two payload words stored as 32-bit offsets from heap_base in
+ * units of the smallest block.  freelist_map has bit k set while the list
+ * of order k is non-empty, so malloc finds the smallest block that fits
+ * with one find-first-set and then splits it down, pushing the upper
+ * halves onto their lists.  Both split and merge take O(log n) steps.
+ *
+ * The heap starts with a minimum-size allocated sentinel, so offset 0 is
+ * never a free block and doubles as NULL.  The heap grows from the break:
+ * extend_heap appends the largest block the break's alignment allows (but
+ * no larger than the request or a page) and frees it, merging it with
+ * free blocks below, until a block of the requested order exists.  Blocks
+ * past the break have no buddy.
+ *
+ * Rounding every request up to a power of two wastes up to half of each
+ * block, so this engine trades utilization for short, predictable paths.
+ * As in mm.c, requests at or above the mmap threshold get a mapping of
+ * their own instead, which keeps a few large blocks from doubling the heap.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "contracts.h"
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+
+// Create aliases for driver tests
+// DO NOT CHANGE THE FOLLOWING!
+#ifdef DRIVER
+#define malloc mm_malloc
+#define free mm_free
+#define realloc mm_realloc
+#define calloc mm_calloc
+#endif
+
+// The aligned allocators go by the mm_ names in driver tests too
+#ifdef DRIVER
+#define memalign mm_memalign
+#define aligned_alloc mm_aligned_alloc
+#define posix_memalign mm_posix_memalign
+#endif
+
+/*
+ *  Logging Functions
+ *  -----------------
+ *  - dbg_printf acts like printf, but will not be run in a release build.
+ *  - checkheap acts like mm_checkheap, but prints the line it failed on and
+ *    exits if it fails.
+ */
+
+#ifndef NDEBUG
+#define dbg_printf(...) printf(__VA_ARGS__)
+#define checkheap(verbose) do {if (mm_checkheap(verbose)) {  \
+                             printf("Checkheap failed on line %d\n", __LINE__);\
+                             exit(-1);  \
+                        }}while(0)
+#else
+#define dbg_printf(...)
+#define checkheap(...)
+#endif
+
+/* single word (4) or double word (8) alignment */
+#define ALIGNMENT 8
+
+//Smallest block: header, padding word and two free list links (16 bytes)
+#define BUDDY_MINORDER 4
+
+//Largest block: 8 GB, the most a heap can hold
+#define BUDDY_MAXORDER 33
+#define BUDDY_ORDERS (BUDDY_MAXORDER + 1)
+
+//extend_heap grows the heap by blocks of up to 2^BUDDY_CHUNKORDER bytes
+//even for smaller requests, to keep memlib calls down
+#define BUDDY_CHUNKORDER 12
+
+//Bytes in front of the payload
+#define BUDDY_HEADER 8
+
+//Header bits: the low ORDERMASK bits hold the order
+#define ORDERMASK 0x3Fu
+#define ALLOCATEDBIT 0x40000000u
+#define OFFSETBIT 0x80000000u
+
+//Requests of at least MMAP_THRESHOLD bytes get a mapping of their own
+//outside the heap, with MAPPEDHEADER bytes in front holding its length;
+//the threshold follows the largest mapping freed, up to MMAP_THRESHOLD_MAX
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (1<<17)
+#endif
+#define MMAP_THRESHOLD_MAX (1<<25)
+#define MAPPEDHEADER 16
+
+static char *heap_base;
+static size_t heap_end;                 //offset of the break from heap_base
+static uint32_t freelist[BUDDY_ORDERS];
+static uint64_t freelist_map;
+static size_t mmap_threshold;
+
+
+/*
+ *  Helper functions
+ *  ----------------
+ */
+
+//block[0] == header, block[2] and block[3] == free list links
+
+// Align p to a multiple of w bytes
+static inline void* align(const void* p, unsigned char w) {
+
+    return (void*)(((uintptr_t)(p) + (w-1)) & ~(w-1));
+
+}
+
+// Check if the given pointer is 8-byte aligned
+static inline int aligned(const void *p) {
+
+    return align(p, 8) == p;
+
+}
+
+// Return whether the pointer is in the heap.
+static int in_heap(const void* p) {
+
+    return p <= mem_heap_hi() && p >= mem_heap_lo();
+
+}
+
+
+/*
+ *  Block Functions
+ *  ---------------
+ */
+
+// Return the order of the given block; it spans 2^order bytes
+static inline unsigned int block_order(const uint32_t* block) {
+
+    REQUIRES(block != NULL);
+
+    REQUIRES(in_heap(block));
+
+    return block[0] & ORDERMASK;
+
+}
+
+// Return true if the block is free, false otherwise
+static inline int block_free(const uint32_t* block) {
+
+    REQUIRES(block != NULL);
+
+    REQUIRES(in_heap(block));
+
+    return !(block[0] & ALLOCATEDBIT);
+
+}
+
+// Write the header of a block
+static inline void block_setHeader(uint32_t* block, unsigned int order,
+                                   int allocated) {
+
+    REQUIRES(block != NULL);
+
+    REQUIRES(order >= BUDDY_MINORDER && order <= BUDDY_MAXORDER);
+
+    block[0] = order | (allocated ? ALLOCATEDBIT : 0);
+
+}
+
+// Return the byte offset of a block from heap_base
+static inline size_t block_position(const uint32_t* block) {
+
+    return (size_t)((const char *)block - heap_base);
+
+}
+
+// Return the block at the given byte offset from heap_base
+static inline uint32_t* position_block(size_t position) {
+
+    return (uint32_t *)(heap_base + position);
+
+}
+
+// Return a pointer to the memory malloc should return
+static inline void* block_mem(uint32_t* const block) {
+
+    REQUIRES(block != NULL);
+
+    REQUIRES(in_heap(block));
+
+    REQUIRES(aligned((char *)block + BUDDY_HEADER));
+
+    return (char *)block + BUDDY_HEADER;
+
+}
+
+// Return the block holding the payload ptr, following the offset of a
+// payload memalign moved past the start of its block
+static inline uint32_t* mem_block(void* const ptr) {
+
+    uint32_t *header = (uint32_t *)((char *)ptr - BUDDY_HEADER);
+
+    if(*header & OFFSETBIT){
+
+        return (uint32_t *)((char *)header - (*header & ~OFFSETBIT));
+
+    }
+
+    return header;
+
+}
+
+// Return how many bytes memalign moved the payload ptr past block_mem
+static inline size_t payload_lead(void* const ptr) {
+
+    return (size_t)((char *)ptr - (char *)mem_block(ptr)) - BUDDY_HEADER;
+
+}
+
+// Return the buddy of a block of the given order, or NULL if the buddy
+// would start past the break
+static inline uint32_t* block_buddy(const uint32_t* block, unsigned int order) {
+
+    size_t position = block_position(block) ^ ((size_t)1 << order);
+
+    return position < heap_end ? position_block(position) : NULL;
+
+}
+
+
+/*
+ *  Free List Functions
+ *  -------------------
+ *  Free blocks store the offsets (in BUDDY_MINORDER units from heap_base)
+ *  of their successor and predecessor in block[2] and block[3].
+ */
+
+// Convert a block pointer to its free list offset
+static inline uint32_t block_offset(const uint32_t* block) {
+
+    return block == NULL ? 0 :
+           (uint32_t)(block_position(block) >> BUDDY_MINORDER);
+
+}
+
+// Convert a free list offset back to a block pointer
+static inline uint32_t* offset_block(uint32_t offset) {
+
+    return offset == 0 ? NULL :
+           position_block((size_t)offset << BUDDY_MINORDER);
+
+}
+
+// Push a free block onto the list for its order
+static inline void list_insert(uint32_t* block, unsigned int order) {
+
+    REQUIRES(block_free(block) && block_order(block) == order);
+
+    uint32_t* succ = offset_block(freelist[order]);
+
+    block[2] = freelist[order];
+    block[3] = 0;
+
+    if(succ != NULL){
+
+        succ[3] = block_offset(block);
+
+    }
+
+    freelist[order] = block_offset(block);
+    freelist_map |= (uint64_t)1 << order;
+
+}
+
+// Unlink a free block from the list for its order
+static inline void list_remove(uint32_t* block, unsigned int order) {
+
+    REQUIRES(block_free(block) && block_order(block) == order);
+
+    uint32_t* pred = offset_block(block[3]);
+    uint32_t* succ = offset_block(block[2]);
+
+    if(pred == NULL){
+
+        freelist[order] = block[2];
+
+    }
+
+    else{
+
+        pred[2] = block[2];
+
+    }
+
+    if(succ != NULL){
+
+        succ[3] = block[3];
+
+    }
+
+    if(freelist[order] == 0){
+
+        freelist_map &= ~((uint64_t)1 << order);
+
+    }
+
+}
+
+
+/*
+ *  Mapped Block Functions
+ *  ----------------------
+ *  A mapped block is a mem_map region whose payload follows MAPPEDHEADER
+ *  bytes in, or lead bytes further for memalign.  The two words before
+ *  the payload hold the length of the region in bytes and the lead.
+ */
+
+// Return whether ptr is a mapped block rather than part of the heap.
+// memlib reserves MAX_HEAP bytes up front, so mappings lie outside it.
+static inline int mapped_owns(const void *ptr) {
+
+    return (size_t)((const char *)ptr - heap_base) >= MAX_HEAP;
+
+}
+
+// Return where the mapping holding a mapped block starts
+static inline char *mapped_base(void *ptr) {
+
+    return (char *)ptr - MAPPEDHEADER - ((size_t *)ptr)[-1];
+
+}
+
+// Give a large request a mapping of its own with the payload on an
+// alignment-byte boundary, a power of two of at least MAPPEDHEADER.  The
+// mapping is alignment - MAPPEDHEADER bytes longer, and the payload slides
+// up by the lead.
+static void *mapped_memalign(size_t alignment, size_t size) {
+
+    size_t pageSize = mem_pagesize();
+    size_t length;
+    size_t lead;
+    char *lo;
+
+    if(size > SIZE_MAX - alignment - pageSize){
+
+        return NULL;
+
+    }
+
+    length = (size + alignment + pageSize - 1) & ~(pageSize - 1);
+
+    if((lo = mem_map(length)) == NULL){
+
+        return NULL;
+
+    }
+
+    lead = (((uintptr_t)lo + MAPPEDHEADER + alignment - 1) &
+            ~(uintptr_t)(alignment - 1)) - ((uintptr_t)lo + MAPPEDHEADER);
+    lo += lead;
+    ((size_t *)lo)[0] = length;
+    ((size_t *)lo)[1] = lead;
+
+    return lo + MAPPEDHEADER;
+
+}
+
+// Give a large request a mapping of its own
+static void *mapped_malloc(size_t size) {
+
+    return mapped_memalign(MAPPEDHEADER, size);
+
+}
+
+// Return the number of payload bytes in a mapped block
+static inline size_t mapped_size(void *ptr) {
+
+    return ((size_t *)ptr)[-2] - MAPPEDHEADER - ((size_t *)ptr)[-1];
+
+}
+
+// Unmap a mapped block
+static inline void mapped_free(void *ptr) {
+
+    size_t length = ((size_t *)ptr)[-2];
+
+    if(length > mmap_threshold && length <= MMAP_THRESHOLD_MAX){
+
+        mmap_threshold = length;
+
+    }
+
+    mem_unmap(mapped_base(ptr));
+
+}
+
+// Resize a mapped block to hold size bytes by remapping its pages, so
+// none of the payload is copied; the lead stays in front.  Returns NULL,
+// leaving the block as it was, if the mapping cannot be resized.
+static void *mapped_realloc(void *ptr, size_t size) {
+
+    size_t pageSize = mem_pagesize();
+    size_t lead = ((size_t *)ptr)[-1];
+    size_t length;
+    char *lo = mapped_base(ptr);
+
+    if(size > SIZE_MAX - MAPPEDHEADER - lead - pageSize){
+
+        return NULL;
+
+    }
+
+    length = (size + MAPPEDHEADER + lead + pageSize - 1) & ~(pageSize - 1);
+
+    if(length == ((size_t *)ptr)[-2]){
+
+        return ptr;
+
+    }
+
+    if((lo = mem_remap(lo, length)) == NULL){
+
+        return NULL;
+
+    }
+
+    lo += lead;
+    ((size_t *)lo)[0] = length;
+
+    return lo + MAPPEDHEADER;
+
+}
+
+
+/*
+ *  Malloc Implementation
+ *  ---------------------
+ */
+
+static int extend_heap(unsigned int order);
+static unsigned int block_release(uint32_t *blockPtr, unsigned int order);
+
+/*
+ * mm_set_policy - the buddy engine has a single placement policy: the
+ * smallest free block that fits, split down to size.
+ */
+void mm_set_policy(enum mm_fit fit, enum mm_order order, unsigned int probes) {
+
+    (void)fit;
+    (void)order;
+    (void)probes;
+
+}
+
+/*
+ * Initialize: return -1 on error, 0 on success.
+ */
+int mm_init(void) {
+
+    if((heap_base = mem_sbrk(1 << BUDDY_MINORDER)) == (void *) -1){
+
+        return -1;
+
+    }
+
+    //Buddy offsets are relative to heap_base, so it must be aligned
+    REQUIRES(align(heap_base, ALIGNMENT) == heap_base);
+
+    memset(freelist, 0, sizeof(freelist));
+    freelist_map = 0;
+    mmap_threshold = MMAP_THRESHOLD;
+
+    //Allocated sentinel at offset 0
+    block_setHeader((uint32_t *)heap_base, BUDDY_MINORDER, 1);
+    heap_end = 1 << BUDDY_MINORDER;
+
+    return 0;
+
+}
+
+
+/*
+ * extend_heap - grow the heap until a free block of at least the given
+ * order exists.  Each step appends the largest block the break's
+ * alignment allows, capped at order or BUDDY_CHUNKORDER, whichever is
+ * larger, and releases it so it merges with free blocks below.  Returns
+ * 0 on success, -1 if memlib is out of memory.
+ */
+static int extend_heap(unsigned int order){
+
+    while(1){
+
+        unsigned int stepOrder = __builtin_ctzll(heap_end);
+        unsigned int maxOrder = order > BUDDY_CHUNKORDER ? order :
+                                                           BUDDY_CHUNKORDER;
+        uint32_t *blockPtr;
+
+        if(stepOrder > maxOrder){
+
+            stepOrder = maxOrder;
+
+        }
+
+        if((blockPtr = mem_sbrk((intptr_t)1 << stepOrder)) == (void *) -1){
+
+            return -1;
+
+        }
+
+        heap_end += (size_t)1 << stepOrder;
+
+        if(block_release(blockPtr, stepOrder) >= order){
+
+            return 0;
+
+        }
+
+    }
+
+}
+
+
+/*
+ * block_release - free a block of the given order, merging it with its
+ * buddy for as long as the buddy is free and whole.  Returns the order of
+ * the block that ends up on a free list.
+ */
+static unsigned int block_release(uint32_t *blockPtr, unsigned int order){
+
+    uint32_t *buddyPtr;
+
+    while(order < BUDDY_MAXORDER &&
+          (buddyPtr = block_buddy(blockPtr, order)) != NULL &&
+          block_free(buddyPtr) && block_order(buddyPtr) == order){
+
+        list_remove(buddyPtr, order);
+
+        if(buddyPtr < blockPtr){
+
+            blockPtr = buddyPtr;
+
+        }
+
+        order++;
+
+    }
+
+    block_setHeader(blockPtr, order, 0);
+    list_insert(blockPtr, order);
+
+    return order;
+
+}
+
+
+/*
+ * request_order - the order of the smallest block that holds size bytes
+ * of payload.  Returns BUDDY_ORDERS if no block is large enough.
+ */
+static unsigned int request_order(size_t size) {
+
+    if(size > ((size_t)1 << BUDDY_MAXORDER) - BUDDY_HEADER){
+
+        return BUDDY_ORDERS;
+
+    }
+
+    if(size <= (1 << BUDDY_MINORDER) - BUDDY_HEADER){
+
+        return BUDDY_MINORDER;
+
+    }
+
+    //ceil(log2(size + BUDDY_HEADER))
+    return 64 - __builtin_clzll(size + BUDDY_HEADER - 1);
+
+}
+
+
+/*
+ * block_take - allocate a block of the given order: take the smallest free
+ * block that fits and split it down.  Returns NULL if the heap cannot grow.
+ */
+static uint32_t *block_take(unsigned int order) {
+
+    unsigned int listOrder;
+    uint64_t available;
+    uint32_t *blockPtr;
+
+    available = freelist_map & ~(((uint64_t)1 << order) - 1);
+
+    if(available == 0){
+
+        if(extend_heap(order) < 0){
+
+            return NULL;
+
+        }
+
+        available = freelist_map & ~(((uint64_t)1 << order) - 1);
+
+    }
+
+    listOrder = __builtin_ctzll(available);
+    blockPtr = offset_block(freelist[listOrder]);
+    list_remove(blockPtr, listOrder);
+
+    //Give back the upper half until the block is the right size
+    while(listOrder > order){
+
+        uint32_t *upperPtr;
+
+        listOrder--;
+        upperPtr = position_block(block_position(blockPtr) +
+                                  ((size_t)1 << listOrder));
+        block_setHeader(upperPtr, listOrder, 0);
+        list_insert(upperPtr, listOrder);
+
+    }
+
+    block_setHeader(blockPtr, order, 1);
+
+    return blockPtr;
+
+}
+
+
+/*
+ * malloc - give large requests a mapping and the rest a heap block of the
+ * smallest order that holds them.
+ */
+void *malloc (size_t size) {
+
+    unsigned int order;
+    uint32_t *blockPtr;
+
+    if(size == 0){
+        return NULL;
+    }
+
+    if(size >= mmap_threshold){
+
+        return mapped_malloc(size);
+
+    }
+
+    if((order = request_order(size)) == BUDDY_ORDERS ||
+       (blockPtr = block_take(order)) == NULL){
+
+        return NULL;
+
+    }
+
+    return block_mem(blockPtr);
+
+}
+
+
+/*
+ * memalign - allocate size bytes on an alignment-byte boundary, which must
+ * be a power of two.  Alignments malloc already gives are plain mallocs,
+ * and large blocks get mappings of their own (mapped_memalign).  Otherwise
+ * the block is sized for the boundary to fall up to alignment - ALIGNMENT
+ * bytes past block_mem.
+ */
+void *memalign(size_t alignment, size_t size) {
+
+    unsigned int order;
+    uint32_t *blockPtr;
+    char *mem;
+    char *ptr;
+
+    if(size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0){
+
+        return NULL;
+
+    }
+
+    if(alignment <= ALIGNMENT){
+
+        return malloc(size);
+
+    }
+
+    if(size >= mmap_threshold){
+
+        return mapped_memalign(alignment, size);
+
+    }
+
+    //The offset must fit below OFFSETBIT
+    if(alignment >= OFFSETBIT || size > SIZE_MAX - alignment ||
+       (order = request_order(size + alignment - ALIGNMENT)) == BUDDY_ORDERS ||
+       (blockPtr = block_take(order)) == NULL){
+
+        return NULL;
+
+    }
+
+    mem = block_mem(blockPtr);
+    ptr = (char *)(((uintptr_t)mem + alignment - 1) &
+                   ~(uintptr_t)(alignment - 1));
+
+    if(ptr != mem){
+
+        *(uint32_t *)(ptr - BUDDY_HEADER) = OFFSETBIT | (uint32_t)(ptr - mem);
+
+    }
+
+    ENSURES(mem_block(ptr) == blockPtr);
+
+    return ptr;
+
+}
+
+
+/*
+ * aligned_alloc - the C11 spelling of memalign
+ */
+void *aligned_alloc(size_t alignment, size_t size) {
+
+    return memalign(alignment, size);
+
+}
+
+
+/*
+ * posix_memalign - memalign that stores the block in *memptr and reports
+ * failure as EINVAL for an alignment that is not a power-of-two multiple
+ * of sizeof(void *) and ENOMEM when out of memory
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+
+    void *ptr;
+
+    if(alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0){
+
+        return EINVAL;
+
+    }
+
+    if(size == 0){
+
+        *memptr = NULL;
+        return 0;
+
+    }
+
+    if((ptr = memalign(alignment, size)) == NULL){
+
+        return ENOMEM;
+
+    }
+
+    *memptr = ptr;
+
+    return 0;
+
+}
+
+
+/*
+ * free - release the block, merging it with its buddies
+ */
+void free (void *ptr) {
+
+    uint32_t *blockPtr;
+
+    if(ptr == NULL){
+
+        return;
+
+    }
+
+    if(mapped_owns(ptr)){
+
+        mapped_free(ptr);
+        return;
+
+    }
+
+    blockPtr = mem_block(ptr);
+
+    REQUIRES(!block_free(blockPtr));
+
+    block_release(blockPtr, block_order(blockPtr));
+
+}
+
+
+/*
+ * mm_trim - without footers the block ending at the break cannot be found
+ * safely, so the buddy heap never shrinks.
+ */
+int mm_trim(size_t pad) {
+
+    (void)pad;
+
+    return 0;
+
+}
+
+
+/*
+ * mm_flush - the buddy engine frees synchronously, so there is nothing to
+ * wait for.
+ */
+void mm_flush(void) {
+
+}
+
+
+/*
+ * mm_usable_size - the payload bytes at ptr: the rest of its block or
+ * mapping.  Returns 0 for NULL.
+ */
+size_t mm_usable_size(void *ptr) {
+
+    if(ptr == NULL){
+
+        return 0;
+
+    }
+
+    if(mapped_owns(ptr)){
+
+        return mapped_size(ptr);
+
+    }
+
+    return ((size_t)1 << block_order(mem_block(ptr))) - BUDDY_HEADER -
+           payload_lead(ptr);
+
+}
+
+
+/*
+ * mm_good_size - the payload malloc provides for size bytes: the rest of
+ * the power of two it rounds up to, or of the pages of its mapping.
+ */
+size_t mm_good_size(size_t size) {
+
+    size_t pageSize = mem_pagesize();
+    unsigned int order;
+
+    if(size == 0){
+
+        return 0;
+
+    }
+
+    if(size >= mmap_threshold){
+
+        if(size > SIZE_MAX - MAPPEDHEADER - pageSize){
+
+            return size;
+
+        }
+
+        return ((size + MAPPEDHEADER + pageSize - 1) & ~(pageSize - 1)) -
+               MAPPEDHEADER;
+
+    }
+
+    if((order = request_order(size)) == BUDDY_ORDERS){
+
+        return size;
+
+    }
+
+    return ((size_t)1 << order) - BUDDY_HEADER;
+
+}
+
+
+/*
+ * mm_malloc_batch - buddy blocks come one power of two at a time, so a
+ * batch is just n mallocs.  Returns how many were allocated.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+
+    size_t index;
+
+    for(index = 0; index < n; index++){
+
+        if((out[index] = malloc(size)) == NULL){
+
+            break;
+
+        }
+
+    }
+
+    return index;
+
+}
+
+
+/*
+ * mm_free_batch - free n objects; buddies merge as each one is freed.
+ */
+void mm_free_batch(void **ptrs, size_t n) {
+
+    size_t index;
+
+    for(index = 0; index < n; index++){
+
+        free(ptrs[index]);
+
+    }
+
+}
+
+
+/*
+ * mm_free_sized - the order sits right in front of the payload, so the
+ * size only serves to check it.
+ */
+void mm_free_sized(void *ptr, size_t size) {
+
+    REQUIRES(ptr == NULL || mapped_owns(ptr) ||
+             block_order(mem_block(ptr)) ==
+             request_order(size + payload_lead(ptr)));
+    (void)size;
+
+    free(ptr);
+
+}
+
+
+/*
+ * block_resize - change an allocated block to the given order in place.
+ * Shrinking gives back upper halves.  Growing works when the block is the
+ * lower buddy at each order up to the new one and every buddy on the way
+ * is free and whole.  Returns 1 on success and 0 if the block must move.
+ */
+static int block_resize(uint32_t *blockPtr, unsigned int order){
+
+    unsigned int oldOrder = block_order(blockPtr);
+    unsigned int growOrder;
+
+    if(order <= oldOrder){
+
+        while(oldOrder > order){
+
+            uint32_t *upperPtr;
+
+            oldOrder--;
+            upperPtr = position_block(block_position(blockPtr) +
+                                      ((size_t)1 << oldOrder));
+            block_setHeader(upperPtr, oldOrder, 0);
+            list_insert(upperPtr, oldOrder);
+
+        }
+
+        block_setHeader(blockPtr, order, 1);
+
+        return 1;
+
+    }
+
+    //Check every buddy above the block before taking any of them
+    for(growOrder = oldOrder; growOrder < order; growOrder++){
+
+        uint32_t *buddyPtr = block_buddy(blockPtr, growOrder);
+
+        if(buddyPtr == NULL || buddyPtr < blockPtr ||
+           !block_free(buddyPtr) || block_order(buddyPtr) != growOrder){
+
+            return 0;
+
+        }
+
+    }
+
+    for(growOrder = oldOrder; growOrder < order; growOrder++){
+
+        list_remove(block_buddy(blockPtr, growOrder), growOrder);
+
+    }
+
+    block_setHeader(blockPtr, order, 1);
+
+    return 1;
+
+}
+
+
+/*
+ * realloc - resize heap blocks in place when their buddies allow it and
+ * remap large blocks in their mappings; otherwise move the data.
+ */
+void *realloc(void *oldptr, size_t size) {
+
+    size_t oldsize;
+    void *newptr;
+
+    /* If size == 0 then this is just free, and we return NULL. */
+    if(size == 0) {
+
+        free(oldptr);
+        return 0;
+
+    }
+
+    /* If oldptr is NULL, then this is just malloc. */
+    if(oldptr == NULL) {
+
+        return malloc(size);
+
+    }
+
+    if(mapped_owns(oldptr)){
+
+        oldsize = mapped_size(oldptr);
+
+        //Stay in the mapping while the block is still a large one; a
+        //shrink that cannot be remapped keeps the pages it has
+        if(size >= mmap_threshold){
+
+            if((newptr = mapped_realloc(oldptr, size)) != NULL){
+
+                return newptr;
+
+            }
+
+            if(size <= oldsize){
+
+                return oldptr;
+
+            }
+
+        }
+
+    }
+
+    else{
+
+        uint32_t *blockPtr = mem_block(oldptr);
+        size_t lead = payload_lead(oldptr);
+
+        oldsize = ((size_t)1 << block_order(blockPtr)) - BUDDY_HEADER - lead;
+
+        //An aligned payload keeps its place, and its lead, in the block
+        if(size < mmap_threshold &&
+           block_resize(blockPtr, request_order(size + lead))){
+
+            return oldptr;
+
+        }
+
+    }
+
+    newptr = malloc(size);
+
+    /* If realloc() fails the original block is left untouched  */
+    if(!newptr) {
+
+        return 0;
+
+    }
+
+    /* Copy the old data. */
+    if(size < oldsize) oldsize = size;
+    memcpy(newptr, oldptr, oldsize);
+
+    /* Free the old block. */
+    free(oldptr);
+
+    return newptr;
+
+}
+
+
+/*
+ * calloc - Allocate the block and set it to zero.  A fresh mapping already
+ * reads as zero.
+ */
+void *calloc (size_t nmemb, size_t size) {
+
+    size_t bytes;
+    void *newptr;
+
+    if(nmemb != 0 && size > SIZE_MAX / nmemb){
+
+        return NULL;
+
+    }
+
+    bytes = nmemb * size;
+
+    if((newptr = malloc(bytes)) != NULL && !mapped_owns(newptr)){
+
+        memset(newptr, 0, bytes);
+
+    }
+
+    return newptr;
+
+}
+
+
+/*
+ * mm_checkheap - walk the heap and the free lists and verify the buddy
+ * invariants.  Returns 0 if no errors were found, otherwise the number of
+ * errors.
+ */
+int mm_checkheap(int verbose) {
+
+    int errors = 0;
+    size_t position;
+    unsigned int order;
+    size_t heapFree = 0;
+    size_t listFree = 0;
+
+    if(heap_end != mem_heapsize()){
+
+        if(verbose) printf("checkheap: break at %zu, heap ends at %zu\n",
+                           mem_heapsize(), heap_end);
+        errors++;
+
+    }
+
+    if(block_free((uint32_t *)heap_base) ||
+       block_order((uint32_t *)heap_base) != BUDDY_MINORDER){
+
+        if(verbose) printf("checkheap: bad sentinel\n");
+        errors++;
+
+    }
+
+    for(position = 0; position < heap_end; position += (size_t)1 << order){
+
+        uint32_t *blockPtr = position_block(position);
+        uint32_t *buddyPtr;
+
+        order = block_order(blockPtr);
+
+        if(order < BUDDY_MINORDER || order > BUDDY_MAXORDER ||
+           position % ((size_t)1 << order) != 0 ||
+           position + ((size_t)1 << order) > heap_end){
+
+            if(verbose) printf("checkheap: bad block %p order %u\n",
+                               (void *)blockPtr, order);
+            errors++;
+            break;
+
+        }
+
+        if(!aligned(block_mem(blockPtr))){
+
+            if(verbose) printf("checkheap: misaligned payload at %p\n",
+                               (void *)blockPtr);
+            errors++;
+
+        }
+
+        if(block_free(blockPtr)){
+
+            heapFree++;
+            buddyPtr = block_buddy(blockPtr, order);
+
+            if(buddyPtr != NULL && block_free(buddyPtr) &&
+               block_order(buddyPtr) == order){
+
+                if(verbose) printf("checkheap: unmerged buddies at %p\n",
+                                   (void *)blockPtr);
+                errors++;
+
+            }
+
+        }
+
+    }
+
+    for(order = 0; order < BUDDY_ORDERS; order++){
+
+        uint32_t *blockPtr;
+        uint32_t *predPtr = NULL;
+        int listed = 0;
+
+        for(blockPtr = offset_block(freelist[order]); blockPtr != NULL;
+            blockPtr = offset_block(blockPtr[2])){
+
+            if(!in_heap(blockPtr) || !block_free(blockPtr) ||
+               block_order(blockPtr) != order){
+
+                if(verbose) printf("checkheap: bad block %p on list %u\n",
+                                   (void *)blockPtr, order);
+                errors++;
+                break;
+
+            }
+
+            if(offset_block(blockPtr[3]) != predPtr){
+
+                if(verbose) printf("checkheap: broken link at %p\n",
+                                   (void *)blockPtr);
+                errors++;
+
+            }
+
+            predPtr = blockPtr;
+            listFree++;
+            listed = 1;
+
+        }
+
+        if(listed != (int)((freelist_map >> order) & 1)){
+
+            if(verbose) printf("checkheap: freelist_map wrong for order %u\n",
+                               order);
+            errors++;
+
+        }
+
+    }
+
+    if(heapFree != listFree){
+
+        if(verbose) printf("checkheap: %zu free blocks, %zu listed\n",
+                           heapFree, listFree);
+        errors++;
+
+    }
+
+    return errors;
+
+}
@@ -2,20 +2,148 @@
  * mm.c
  * hbovik - Harry Bovik
  *
- * NOTE TO STUDENTS: Replace this header comment with your own header
- * comment that gives a full description of your solution.
+ * Segregated-fit allocator built on boundary tags.
+ *
+ * Every block carries a one-word header holding its size (in 4-byte
+ * words), its allocated bit and a bit telling whether the previous block
+ * is allocated.  Only free blocks have a footer (a copy of the size), since
+ * coalesce only ever needs to find a previous block that is free; the
+ * payload of an allocated block runs right up to the next header.  Free
+ * blocks are additionally threaded onto one of SEGLIST_COUNT doubly-linked
+ * free lists according to their size class; the links live in the first
+ * two payload words of the free block and are stored as 32-bit word
+ * offsets from the start of the heap, so the smallest block is four words.
+ *
+ * Size classes: block sizes up to SEGLIST_SMALL_WORDS words each get their
+ * own exact class, so any block at the head of such a list satisfies a
+ * request of that class.  Larger blocks are grouped into power-of-two
+ * classes.  find_fit searches the request's own class first-fit and then
+ * takes the first block of the next non-empty class, which makes lookups
+ * close to constant time independent of how many blocks the heap holds.
+ *
+ * Placement within a class follows the policy chosen with mm_set_policy
+ * and latched by mm_init: first-fit, next-fit (a roving pointer per class),
+ * best-fit, or good-fit (best of the fits seen within a bounded number of
+ * probes), with blocks inserted LIFO or in address order.  The default is
+ * first-fit with LIFO insertion.
+ *
+ * Built with -DTLSF the size classes become a two-level segregated fit:
+ * power-of-two first-level ranges each split into TLSF_SL_COUNT linear
+ * second-level classes, with bitmaps of the non-empty classes.  find_fit
+ * then rounds the request up to a class boundary and locates a list with
+ * two find-first-set instructions, so malloc and free run in constant time.
+ *
+ * Built with -DSLAB, requests of up to SLAB_MAX_SIZE bytes bypass the
+ * block lists and are served from slab runs: page-sized heap blocks
+ * divided into equal slots whose occupancy is a bitmap in the run header,
+ * so small objects carry no header or footer of their own (see the Slab
+ * Functions below).  Each size class in use pins at least one page, so
+ * a size moves to runs only once its slot saves space over a heap block
+ * and the arena holds SLAB_MIN_DEMAND runs' worth of such blocks.
+ *
+ * Built with -DQUICKLISTS, free parks blocks of up to QUICKLIST_MAX_WORDS
+ * words on a LIFO list per exact size without coalescing them, and malloc
+ * reuses them in constant time; the lists are merged into the heap in bulk
+ * when one overflows or the free lists have no fit (see the Quick List
+ * Functions below).
+ *
+ * Requests at or above the mmap threshold never enter the heap: each
+ * gets its own page-aligned mapping from mem_map, which free unmaps
+ * directly, and realloc resizes with mem_remap so that growing buffers
+ * move whole pages instead of copying their payload.  Any pointer outside
+ * the heap is such a mapped block.  The threshold starts at
+ * MMAP_THRESHOLD and follows the largest mapping freed so far, so
+ * short-lived large blocks stop paying for syscalls.
+ *
+ * Built with -DTHREADS the allocator is thread-safe: the arena lock
+ * serializes every operation on the shared heap, and in front of it each
+ * thread keeps a cache of freed blocks per size (see the Thread Cache
+ * Functions below) so that the common malloc/free pair never takes the lock.
+ * -DARENAS goes further and gives up to MM_ARENAS groups of threads a heap
+ * of their own, each with its own lock, in a region carved off the top of
+ * the memlib reservation (see the Arena Functions below).  -DRSEQ instead
+ * replaces the thread caches with per-CPU caches driven by Linux
+ * restartable sequences (see the CPU Cache Functions below), and
+ * -DCLASSLOCKS replaces the one heap lock with a lock per size class (see
+ * the Size Class Lock Functions below).  -DLOCKFREE serves requests of up
+ * to LOCKFREE_MAX_SIZE bytes from global lock-free stacks (see the
+ * Lock-Free Stack Functions below).  -DASYNCFREE queues the frees that
+ * would take the heap lock for a background reclaimer thread (see the Free
+ * Ring Functions below); mm_flush waits for the queue to empty.
+ *
+ * mm_trim returns free space at the top of the heap to memlib by moving
+ * the break (and the epilogue) down; free calls it whenever the last
+ * block grows past TRIM_THRESHOLD bytes.
+ *
+ * calloc only clears what may hold old data.  Mappings are fresh, and
+ * each arena keeps a zero mark (heap_zero): memory above it has not been
+ * handed out since memlib first gave it to the heap, so only the top
+ * block's own header, links and footer are set there.  Allocating moves
+ * the mark up past the block, and a heap growth into memory a break has
+ * reached before moves it to the new break.
+ *
+ * mm_memalign and its variants find a block with room to slide the payload
+ * up to the boundary and split the slack in front off as a free block of
+ * its own (block_placeAligned, which also places slab runs).
+ *
+ * free, coalesce, block_place and extend_heap maintain the invariant that
+ * every free block in the heap is on exactly one list and no two free
+ * blocks are adjacent (-DCLASSLOCKS lets a free whose neighbour's class
+ * is busy leave the two apart until heap_consolidate).
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//Arenas, per-CPU caches, size class locks, lock-free stacks and
+//asynchronous frees build on the thread-safe build
+#if (defined(ARENAS) || defined(RSEQ) || defined(CLASSLOCKS) || \
+     defined(LOCKFREE) || defined(ASYNCFREE)) && !defined(THREADS)
+#define THREADS
+#endif
+
+#if defined(ASYNCFREE) && defined(ARENAS)
+#error "-DASYNCFREE cannot be combined with -DARENAS"
+#endif
+
+#if defined(LOCKFREE) && (defined(ARENAS) || defined(SLAB))
+#error "-DLOCKFREE cannot be combined with -DARENAS or -DSLAB"
+#endif
+
+#if defined(CLASSLOCKS) && (defined(ARENAS) || defined(TLSF) || defined(SLAB))
+#error "-DCLASSLOCKS cannot be combined with -DARENAS, -DTLSF or -DSLAB"
+#endif
+
+#if defined(QUICKLISTS) && defined(CLASSLOCKS)
+#error "-DQUICKLISTS cannot be combined with -DCLASSLOCKS"
+#endif
+
+#ifdef RSEQ
+#if defined(ARENAS) || !defined(__x86_64__)
+#error "-DRSEQ needs x86-64 and cannot be combined with -DARENAS"
+#endif
+#include <sys/rseq.h>
+#endif
+
+#ifdef THREADS
+#include <pthread.h>
+#endif
+#ifdef ASYNCFREE
+#include <time.h>
+#endif
 #include "contracts.h"
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 
 // Create aliases for driver tests
@@ -27,6 +155,13 @@
 #define calloc mm_calloc
 #endif
 
+// The aligned allocators go by the mm_ names in driver tests too
+#ifdef DRIVER
+#define memalign mm_memalign
+#define aligned_alloc mm_aligned_alloc
+#define posix_memalign mm_posix_memalign
+#endif
+
 /*
  *  Logging Functions
  *  -----------------
@@ -53,17 +188,374 @@
 #define FREE 0
 #define CHUNKSIZE (1<<12)
 
-//remove after complete implementation
-#define SIZE_PTR(p)  ((size_t*)(((char*)(p)) - SIZE_T_SIZE))
-#define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+//The heap grows by at least a chunk.  Each growth doubles the chunk, up
+//to HEAP_GROW_MAX bytes and while it stays below 1/HEAP_GROW_SHARE of the
+//heap, so a burst of allocation takes few trips to memlib without a small
+//heap overshooting its peak; a free that reaches the top of the heap
+//starts it over at CHUNKSIZE.
+#define HEAP_GROW_MAX (1<<16)
+#define HEAP_GROW_SHARE 8
+
+//free gives the top of the heap back once the last block is free and at
+//least TRIM_THRESHOLD bytes, keeping TRIM_PAD bytes for the next requests
+#define TRIM_THRESHOLD (1<<17)
+#define TRIM_PAD CHUNKSIZE
+
+//Requests of at least MMAP_THRESHOLD bytes get a mapping of their own
+//outside the heap, with MAPPEDHEADER bytes in front holding its length
+//and how far an aligned payload sits past the usual spot.
+//Freeing a mapping raises the threshold to its length, up to
+//MMAP_THRESHOLD_MAX, so sizes the program keeps recycling move to the heap.
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (1<<17)
+#endif
+#define MMAP_THRESHOLD_MAX (1<<25)
+#define MAPPEDHEADER 16
+
+//calloc clears requests of up to CALLOC_CLEAR_SIZE bytes outright, as the
+//caches may serve them.  Larger ones skip what lay above the zero mark,
+//and clear CALLOC_STREAM_SIZE bytes or more with non-temporal stores.
+#define CALLOC_CLEAR_SIZE 256
+#define CALLOC_STREAM_SIZE (1<<18)
+
 /* single word (4) or double word (8) alignment */
 #define ALIGNMENT 8
 
-static uint32_t* heap_listp;
+//Smallest block: header, two free list links and footer (in words)
+#define MINBLOCKWORDS 4
+
+//Headers and footers keep the size in doublewords in their low 30 bits,
+//so a heap block can span up to 8 GiB; the heap must fit in one block
+#define SIZEMASK 0x3FFFFFFFu
+#define MAXBLOCKWORDS (SIZEMASK * 2)
+#define ALLOCATEDBIT 0x40000000u
+#define PREVALLOCATEDBIT 0x80000000u
+
+#if MAX_HEAP > (SIZEMASK + 1ULL) * DOUBLEWORDSIZE
+#error "MAX_HEAP is larger than the biggest block a header can describe"
+#endif
+
+#ifdef TLSF
+
+//Each power-of-two range of block sizes (in doublewords) is split into
+//TLSF_SL_COUNT second-level classes; sizes below TLSF_SL_COUNT doublewords
+//all land in first-level class 0 with one class per size.  Sizes span
+//the 30 bits of SIZEMASK, so the top range starts at 2^29 doublewords.
+#define TLSF_SL_LOG 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG)
+#define TLSF_FL_COUNT (30 - TLSF_SL_LOG + 1)
+#define SEGLIST_COUNT (TLSF_FL_COUNT * TLSF_SL_COUNT)
+
+#if (SIZEMASK >> (TLSF_FL_COUNT + TLSF_SL_LOG - 1)) != 0
+#error "TLSF_FL_COUNT does not cover every size a header can hold"
+#endif
+
+#else
+
+//Blocks up to this many words get an exact size class each
+#define SEGLIST_SMALL_WORDS 32
+#define SEGLIST_SMALL_COUNT ((SEGLIST_SMALL_WORDS - MINBLOCKWORDS) / 2 + 1)
+
+//Power-of-two classes cover (2^(k-1), 2^k] words up to 2^31 (MAXBLOCKWORDS)
+#define SEGLIST_LOG_SMALL 5
+#define SEGLIST_COUNT (SEGLIST_SMALL_COUNT + 31 - SEGLIST_LOG_SMALL)
+
+#endif
+
+#ifdef QUICKLISTS
+
+//Freed blocks of up to QUICKLIST_MAX_WORDS words wait, still marked
+//allocated and uncoalesced, on a LIFO quick list per exact size, up to
+//QUICKLIST_COUNT blocks per list
+#define QUICKLIST_MAX_WORDS 64
+#define QUICKLIST_CLASSES ((QUICKLIST_MAX_WORDS - MINBLOCKWORDS) / 2 + 1)
+#define QUICKLIST_COUNT 8
+
+#endif
+
+#ifdef THREADS
+
+//Each thread caches up to TCACHE_COUNT freed blocks per size class for
+//blocks of up to TCACHE_MAX_WORDS words, and moves TCACHE_BATCH of them
+//at a time between its cache and the shared heap
+#define TCACHE_MAX_WORDS 64
+#define TCACHE_CLASSES ((TCACHE_MAX_WORDS - MINBLOCKWORDS) / 2 + 1)
+#define TCACHE_COUNT 32
+#define TCACHE_BATCH 16
+
+//Bumped by mm_init so that caches filled from an earlier heap are dropped
+static unsigned int heap_generation;
+
+struct tcache {
+    void *head[TCACHE_CLASSES];         //linked through the first payload word
+    uint32_t count[TCACHE_CLASSES];
+    unsigned int generation;
+};
+
+#ifndef RSEQ
+static __thread struct tcache tcache;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+#endif
+
+#endif
+
+#ifdef RSEQ
+
+//With -DRSEQ the thread caches give way to one cache per CPU, holding up
+//to CPUCACHE_COUNT blocks per thread cache size class; CPUs numbered
+//CPUCACHE_CPUS and up go straight to the heap
+#define CPUCACHE_CPUS 256
+#define CPUCACHE_COUNT 64
+
+//Each stack head packs the number of blocks on the stack above the list
+//offset of the top block, so one store commits a push or a pop.  A cached
+//block keeps the head word it replaced in its first payload doubleword.
+struct cpucache {
+    uint64_t head[TCACHE_CLASSES];
+} __attribute__((aligned(64)));
+
+enum cpucache_status { CPUCACHE_HIT, CPUCACHE_MISS, CPUCACHE_ABORTED };
+
+static struct cpucache cpucaches[CPUCACHE_CPUS];
+
+#endif
+
+#ifdef LOCKFREE
+
+//With -DLOCKFREE requests of up to LOCKFREE_MAX_SIZE bytes bypass the
+//caches and the heap lock: their blocks go on one global stack per block
+//size, refilled from the heap LOCKFREE_BATCH blocks at a time
+#define LOCKFREE_MAX_SIZE 64
+#define LOCKFREE_MAX_WORDS \
+    ((LOCKFREE_MAX_SIZE + WORDSIZE + DOUBLEWORDSIZE - 1) / DOUBLEWORDSIZE * 2)
+#define LOCKFREE_CLASSES ((LOCKFREE_MAX_WORDS - MINBLOCKWORDS) / 2 + 1)
+#define LOCKFREE_BATCH 32
+
+//A stack head packs a tag, bumped by every push, above the list offset of
+//the top block; stacked blocks link through their first payload word.
+//Each head has a cache line to itself.
+struct lockfree_stack {
+    uint64_t head;
+} __attribute__((aligned(64)));
+
+static struct lockfree_stack lockfree_stacks[LOCKFREE_CLASSES];
+
+#endif
+
+#ifdef ASYNCFREE
+
+//With -DASYNCFREE free hands heap blocks to a reclaimer thread through a
+//ring of FREERING_SIZE slots per thread, for up to FREERING_COUNT threads
+//at once.  The reclaimer frees up to FREERING_BATCH blocks of a ring per
+//heap lock hold; when it has nothing to do it dozes for FREERING_DOZE_NS
+//at a time, and after FREERING_DOZES idle dozes sleeps until woken.
+//malloc frees whatever its own thread has queued before it takes the
+//heap lock, so a thread reuses its memory without waiting for the
+//reclaimer.
+#define FREERING_COUNT 64
+#define FREERING_SIZE 256
+#define FREERING_BATCH 64
+#define FREERING_DOZE_NS 1000000
+#define FREERING_DOZES 16
+
+//A single-producer single-consumer ring: its thread advances tail, and
+//whoever holds the ring's lock advances head.  inUse is set while a live
+//thread owns the ring.
+struct freering {
+    void *slot[FREERING_SIZE];
+    unsigned int head __attribute__((aligned(64)));
+    pthread_mutex_t lock;
+    unsigned int tail __attribute__((aligned(64)));
+    int inUse;
+};
+
+enum freering_state { FREERING_AWAKE, FREERING_DOZING, FREERING_ASLEEP };
+
+static struct freering freerings[FREERING_COUNT];
+static __thread struct freering *freering;
+static __thread int freering_claimed;
+static pthread_key_t freering_key;
+static pthread_once_t freering_once = PTHREAD_ONCE_INIT;
+static int freering_running;
+
+static pthread_mutex_t freering_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t freering_wake = PTHREAD_COND_INITIALIZER;
+static enum freering_state freering_state;
+
+static void freering_start(void);
+
+#endif
+
+// Shared by every arena, so it is read and raised with atomic accesses
+static size_t mmap_threshold;
+
+//Placement policy requested by mm_set_policy and the one latched by mm_init
+struct placement {
+    enum mm_fit fit;
+    enum mm_order order;
+    unsigned int probes;
+};
+
+static struct placement placement_request = { MM_FIT_FIRST, MM_ORDER_LIFO, 8 };
+static struct placement placement;
+
+#ifdef SLAB
+
+//Slab runs: one page per run, slots in multiples of ALIGNMENT bytes.  A
+//run's block header is the second word of its page, so that the run
+//header it holds starts SLAB_RUNOFFSET bytes in and runs tile the heap.
+#define SLAB_RUNSIZE 4096
+#define SLAB_RUNOFFSET (2 * WORDSIZE)
+#define SLAB_MAX_SIZE 128
+#define SLAB_CLASSES (SLAB_MAX_SIZE / ALIGNMENT)
+#define SLAB_BITMAP_WORDS ((SLAB_RUNSIZE / ALIGNMENT + 63) / 64)
+
+//A run pins a page however few slots are used, so a size goes to runs
+//only when its slot is smaller than its heap block and the arena holds
+//live heap blocks of that size worth SLAB_MIN_DEMAND runs
+#ifndef SLAB_MIN_DEMAND
+#define SLAB_MIN_DEMAND 12
+#endif
+
+//Header at the start of every run's payload; slots follow it
+struct slab_run {
+    uint32_t next;              //page of the next run with free slots
+    uint32_t prev;              //page of the previous run with free slots
+    uint16_t slotSize;          //bytes per slot
+    uint16_t slotCount;         //slots in this run
+    uint16_t freeCount;         //slots not in use
+    uint16_t sizeClass;
+    uint64_t used[SLAB_BITMAP_WORDS];
+};
+
+//One bit per SLAB_RUNSIZE page of the heap, set when the page is a run
+static uint8_t slab_pageMap[MAX_HEAP / SLAB_RUNSIZE / 8 + 1];
+
+static inline int slab_ready(size_t size);
+static inline void slab_count(uint32_t words, int live);
+static void *slab_malloc(size_t size);
+static void slab_free(void *ptr);
+static inline int slab_owns(const void *ptr);
+
+#endif
+
+/*
+ * An arena is a heap with its own free lists.  Without -DARENAS there is
+ * just the one, and arena always points at it.
+ */
+#ifdef ARENAS
+
+//Threads are spread round-robin over MM_ARENAS arenas.  Arena 0 grows the
+//main memlib break; arena k > 0 has a region of ARENA_REGION bytes, the
+//k-th one down from the top of the reservation, with a break of its own
+#ifndef MM_ARENAS
+#define MM_ARENAS 8
+#endif
+#ifndef ARENA_REGION
+#define ARENA_REGION (((size_t)MAX_HEAP / 2 / MM_ARENAS) & ~(size_t)0x7FFF)
+#endif
+
+#else
+#define MM_ARENAS 1
+#endif
+
+struct arena {
+    uint32_t *heap_listp;               //prologue header
+    uint32_t *heap_base;                //start of the heap, which offsets
+                                        //count from
+    size_t heap_size;                   //bytes from heap_base to the break
+    uint32_t heap_chunk;                //words the next growth adds at least
+    uint32_t *heap_zero;                //zero mark: the words from here to
+                                        //the break are zero but for the
+                                        //top block's header, links and
+                                        //footer and the epilogue
+    uint32_t seglist[SEGLIST_COUNT];
+    uint32_t seglist_rover[SEGLIST_COUNT];
+#ifdef TLSF
+    //Bit fl is set when first-level class fl has a non-empty second level;
+    //bit sl of tlsf_slMap[fl] is set when list fl * TLSF_SL_COUNT + sl is
+    uint32_t tlsf_flMap;
+    uint32_t tlsf_slMap[TLSF_FL_COUNT];
+#endif
+#ifdef SLAB
+    uint32_t slab_partial[SLAB_CLASSES];    //runs with a free slot, per class
+    uint32_t slab_demand[SLAB_CLASSES];     //live small heap blocks
+#endif
+#ifdef QUICKLISTS
+    uint32_t quicklist[QUICKLIST_CLASSES];  //linked through the first
+                                            //payload word, per size
+    uint8_t quicklist_count[QUICKLIST_CLASSES];
+    unsigned int quicklist_total;           //blocks on all quick lists
+#endif
+#ifdef CLASSLOCKS
+    pthread_rwlock_t lock;              //shared by malloc and free, exclusive
+                                        //to reshape the heap
+    pthread_mutex_t seglist_lock[SEGLIST_COUNT];
+    uint64_t seglist_map;               //bit i is set while list i is non-empty
+    unsigned int unmerged;              //merges free could not make
+#elif defined(THREADS)
+    pthread_mutex_t lock;               //serializes every operation on the heap
+#endif
+#ifdef ARENAS
+    int region;                         //memlib region holding the heap
+    void *remote;                       //blocks other threads freed, to drain
+#endif
+};
+
+#ifdef CLASSLOCKS
+static struct arena arenas[MM_ARENAS] = {
+    [0] = { .lock = PTHREAD_RWLOCK_INITIALIZER }
+};
+#elif defined(THREADS)
+static struct arena arenas[MM_ARENAS] = {
+    [0] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+#else
+static struct arena arenas[MM_ARENAS];
+#endif
+
+#ifdef ARENAS
+
+//The calling thread's arena, valid while arena_generation is current
+static __thread struct arena *arena = &arenas[0];
+static __thread unsigned int arena_generation;
+
+//Arenas set up since mm_init (they are created in order), the round-robin
+//counter and whether a region could not be had
+static unsigned int arena_count;
+static unsigned int arena_next;
+static int arena_exhausted;
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#else
+static struct arena *const arena = &arenas[0];
+#endif
+
+#if defined(ARENAS) || defined(CLASSLOCKS)
+//Mapped blocks come and go outside any one heap lock
+static pthread_mutex_t mapped_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+//One bit per MINBLOCKWORDS words of the reservation, set while the block
+//whose header lies there is one realloc has grown; no two headers are
+//closer than that
+#define GROWNGRAIN (MINBLOCKWORDS * WORDSIZE)
+static uint8_t grown_map[MAX_HEAP / GROWNGRAIN / 8 + 1];
+
+static inline uint32_t block_pack(uint32_t size, int allocated);
 static void *coalesce (void *blockPtr);
 static void *extend_heap(uint32_t words);
-static void block_place(uint32_t *blockPtr, uint32_t checkSize);
+static void block_place(uint32_t *blockPtr, uint32_t words);
+static uint32_t *block_placeAligned(uint32_t words, uint32_t alignment,
+                                    uint32_t offset);
+static void *mapped_malloc(size_t size);
+static void *mapped_memalign(size_t alignment, size_t size);
+#ifndef CLASSLOCKS
+static void block_retire(uint32_t *blockPtr);
+#endif
+static int heap_init(void);
+static int heap_trim(size_t pad);
 
 /*
  *  Helper functions
@@ -71,26 +563,84 @@ static void block_place(uint32_t *blockPtr, uint32_t checkSize);
  */
 
 //block[0] == header
-//block[block_size(block)+1] == footer
+//block[block_size(block)-1] == footer
 
 // Align p to a multiple of w bytes
-static inline void* align(const void const* p, unsigned char w) {
-    
+static inline void* align(const void* p, size_t w) {
+
     return (void*)(((uintptr_t)(p) + (w-1)) & ~(w-1));
 
 }
 
 // Check if the given pointer is 8-byte aligned
-static inline int aligned(const void const *p) {
-    
+static inline int aligned(const void *p) {
+
     return align(p, 8) == p;
 
 }
 
-// Return whether the pointer is in the heap.
-static int in_heap(const void* p) {
-    
-    return p <= mem_heap_hi() && p >= mem_heap_lo();
+// Return whether the pointer is in the heap.  Thread caches check their
+// blocks without the heap lock, so the size is read atomically.
+static inline int in_heap(const void* p) {
+
+    return (size_t)((const char *)p - (const char *)arena->heap_base) <
+           __atomic_load_n(&arena->heap_size, __ATOMIC_RELAXED);
+
+}
+
+// Move the break by incr bytes, returning the old break like mem_sbrk
+static void *heap_sbrk(intptr_t incr) {
+
+#ifdef ARENAS
+    void *oldBrk = mem_region_sbrk(arena->region, incr);
+#else
+    void *oldBrk = mem_sbrk(incr);
+#endif
+
+    if(oldBrk != (void *) -1){
+
+        __atomic_store_n(&arena->heap_size, arena->heap_size + incr,
+                         __ATOMIC_RELAXED);
+
+    }
+
+    return oldBrk;
+
+}
+
+// Take the heap lock (a no-op unless built with -DTHREADS).  With
+// -DCLASSLOCKS it is only held shared, and the free lists are guarded by
+// the locks of their size classes.
+static inline void heap_acquire(void) {
+
+#ifdef CLASSLOCKS
+    pthread_rwlock_rdlock(&arena->lock);
+#elif defined(THREADS)
+    pthread_mutex_lock(&arena->lock);
+#endif
+
+}
+
+// Take the heap lock with no other thread in the heap, as walking or
+// reshaping it requires
+static inline void heap_acquireExclusive(void) {
+
+#ifdef CLASSLOCKS
+    pthread_rwlock_wrlock(&arena->lock);
+#elif defined(THREADS)
+    pthread_mutex_lock(&arena->lock);
+#endif
+
+}
+
+// Release the heap lock
+static inline void heap_release(void) {
+
+#ifdef CLASSLOCKS
+    pthread_rwlock_unlock(&arena->lock);
+#elif defined(THREADS)
+    pthread_mutex_unlock(&arena->lock);
+#endif
 
 }
 
@@ -98,547 +648,4729 @@ static int in_heap(const void* p) {
 /*
  *  Block Functions
  *  ---------------
- *  TODO: Add your comment describing block functions here.
  *  The functions below act similar to the macros in the book, but calculate
- *  size in multiples of 4 bytes.
+ *  size in multiples of 4 bytes.  A block's size includes its header and
+ *  footer.
  */
 
+// Read a block's header.  Thread caches read the headers of blocks they
+// hold without the heap lock while the owner of the block before may be
+// flipping the previous-allocated bit, so with -DTHREADS headers are read
+// and their bits written atomically.  With -DCLASSLOCKS both owners may
+// change the same header at once, so the bit updates are atomic as a whole.
+static inline uint32_t block_header(const uint32_t* block) {
+
+#ifdef THREADS
+    return __atomic_load_n(block, __ATOMIC_RELAXED);
+#else
+    return block[0];
+#endif
+
+}
+
+// Set the given bits of a block's header
+static inline void block_setBits(uint32_t* block, uint32_t bits) {
+
+#ifdef CLASSLOCKS
+    __atomic_fetch_or(block, bits, __ATOMIC_RELAXED);
+#elif defined(THREADS)
+    __atomic_store_n(block, block[0] | bits, __ATOMIC_RELAXED);
+#else
+    block[0] |= bits;
+#endif
+
+}
+
+// Clear the given bits of a block's header
+static inline void block_clearBits(uint32_t* block, uint32_t bits) {
+
+#ifdef CLASSLOCKS
+    __atomic_fetch_and(block, ~bits, __ATOMIC_RELAXED);
+#elif defined(THREADS)
+    __atomic_store_n(block, block[0] & ~bits, __ATOMIC_RELAXED);
+#else
+    block[0] &= ~bits;
+#endif
+
+}
+
 // Return the size of the given block in multiples of the word size
 static inline unsigned int block_size(const uint32_t* block) {
-    
-    dbg_printf("\nBlock SIZE \n");
-    
+
     REQUIRES(block != NULL);
-    
+
     REQUIRES(in_heap(block));
 
-    return (block[0] & 0x3FFFFFFF);
+    return (block_header(block) & SIZEMASK) << 1;
 
 }
 
 // Return true if the block is free, false otherwise
 static inline int block_free(const uint32_t* block) {
-    
-    int a = in_heap(block);
-    
-    printf("\nBlock FREE \n");
-    
-    REQUIRES(block != NULL);
-    
-    if(a>0){
-    
-        REQUIRES(a);
-    
-    }
-    
-    return !(block[0] & 0x40000000);
 
-}
-
-// Mark the given block as free(1)/alloced(0) by marking the header and footer.
-static inline void block_mark(uint32_t* block, int free) {
-    
-    dbg_printf("\nBlock MARK \n");
-    
     REQUIRES(block != NULL);
-    
+
     REQUIRES(in_heap(block));
 
-    unsigned int next = block_size(block) + 1;
-    
-    block[0] = free ? block[0] & (int) 0xBFFFFFFF : block[0] | 0x40000000;
-    
-    block[next] = block[0];
+    return !(block_header(block) & ALLOCATEDBIT);
 
 }
 
+// Return true if the block before this one is allocated (has no footer)
+static inline int block_prevAllocated(const uint32_t* block) {
 
-// Return a pointer to the memory malloc should return
-static inline uint32_t* block_mem(uint32_t* const block) {
-    
-    dbg_printf("\nBlock MEM \n");
-    
     REQUIRES(block != NULL);
-    
+
     REQUIRES(in_heap(block));
-    
-    REQUIRES(aligned(block + 1));
 
-    return block + 1;
+    return (block_header(block) & PREVALLOCATEDBIT) != 0;
 
 }
 
+// Record in a block's header whether the block before it is allocated
+static inline void block_setPrevAllocated(uint32_t* block, int prevAllocated) {
 
-// Return the header to the previous block
-static inline uint32_t* block_prev(uint32_t* const block) {
-    
-    dbg_printf("\nBlock PREV \n");
-    
     REQUIRES(block != NULL);
-    
+
     REQUIRES(in_heap(block));
 
-    uint32_t* result;
-    
-    if(block_size(block - 1) == 0){
-    
-        result = block - 1;
-    
+    if(prevAllocated){
+
+        block_setBits(block, PREVALLOCATEDBIT);
+
     }
-    
+
     else{
-    
-        result = block - block_size(block - 1);
-    
-    }
 
-    return result;
+        block_clearBits(block, PREVALLOCATEDBIT);
+
+    }
 
 }
 
+// Return the grown_map bit number of a block
+static inline size_t block_grownBit(const uint32_t* block) {
 
-// Return the header to the next block
-static inline uint32_t* block_next(uint32_t* const block) {
-    
-    dbg_printf("\nBlock NEXT \n");
-    
-    REQUIRES(block != NULL);
-    
-    REQUIRES(in_heap(block));
+    return (size_t)((const char *)block -
+                    (const char *)arenas[0].heap_base) / GROWNGRAIN;
 
-    uint32_t* result;
-    
-    if(block_size(block) == 0){
-    
-        result = block + 1;
-   
-    }
-    
-    else{
-        
-        result = block + block_size(block);
-        
-    }
-    
-    return result;
-    
 }
 
+// Return true if realloc has grown this allocated block, a hint that it
+// will be grown again.  The block may be in any arena.
+static inline int block_grown(const uint32_t* block) {
 
-//Read value at address
-static inline uint32_t block_getValAtPtr(uint32_t* const ptr ){
+    REQUIRES(block != NULL);
 
-    REQUIRES(ptr != NULL);
-    
-    uint32_t value;
-    
-    value = (*ptr);
-    
-    return value;
-    
-}
+    size_t bit = block_grownBit(block);
 
+    return (__atomic_load_n(&grown_map[bit / 8], __ATOMIC_RELAXED) >>
+            (bit % 8)) & 1;
 
-//Write value to address
-static inline void block_setValAtPtr(uint32_t* const ptr, int value ){
-    
-    dbg_printf("\nSET VAL AT PTR\n");
-    
-    REQUIRES(ptr != NULL);
-    
-    *ptr = value;
-    
 }
 
+// Record whether realloc has grown a block, which may be in any arena.  A
+// byte of grown_map covers eight blocks that threads may grow and free at
+// once, so it changes by atomic read-modify-write in threaded builds.
+static inline void block_setGrown(uint32_t* block, int grown) {
 
-//Generate header and footer content
-static inline uint32_t block_pack(int size,int allocated){
-    
-    dbg_printf("\nBlock PACK \n");
-    
-    REQUIRES(allocated == 1 || allocated == 0);
-    
-    int headfootValue = (allocated<<30) | (size);
-    
-    return headfootValue;
-    
-}
+    REQUIRES(block != NULL);
 
+    size_t bit = block_grownBit(block);
+    uint8_t mask = (uint8_t)(1 << (bit % 8));
 
-/*
- *  Malloc Implementation
- *  ---------------------
- *  The following functions deal with the user-facing malloc implementation.
- */
+#if defined(THREADS) || defined(CLASSLOCKS)
+    if(grown){
+
+        __atomic_fetch_or(&grown_map[bit / 8], mask, __ATOMIC_RELAXED);
 
-/*
- * Initialize: return -1 on error, 0 on success.
- */
-int mm_init(void) {
-    
-    dbg_printf("\nMM_INIT \n");
-    
-    if((heap_listp = mem_sbrk(4 * WORDSIZE)) == (void *) -1){
-        
-        return -1;
-    
-    }
-    
-    block_setValAtPtr(heap_listp,block_pack(1, ALLOCATED));
-    block_setValAtPtr(heap_listp + 1, block_pack(DOUBLEWORDSIZE/WORDSIZE, ALLOCATED));
-    block_setValAtPtr(heap_listp + 2 , block_pack(DOUBLEWORDSIZE/WORDSIZE, ALLOCATED));
-    block_setValAtPtr(heap_listp + 3, block_pack(0, ALLOCATED));
-    
-    heap_listp++;
-    heap_listp++;
-    
-    dbg_printf("\n%d\n",CHUNKSIZE);
-    dbg_printf("\n%d\n",WORDSIZE);
-    
-    int extendSize = CHUNKSIZE/WORDSIZE;
-    
-    dbg_printf("\n%d\n",extendSize);
-    
-    if((uint32_t *)extend_heap(extendSize) == NULL){
-    
-        return -1;
-    
     }
-    
-    return 0;
 
-}
+    else{
 
+        __atomic_fetch_and(&grown_map[bit / 8], (uint8_t)~mask,
+                           __ATOMIC_RELAXED);
 
+    }
+#else
+    if(grown){
 
-static void *extend_heap(uint32_t words){
+        grown_map[bit / 8] |= mask;
 
-    dbg_printf("\nExtend Heap \n");
-    
-    uint32_t *blockPtr;
-    uint32_t *nextBlock;
-    uint32_t *prevPtr;
-    uint32_t *result;
-    
-    //For allocation of even number of words in a heap
-    uint32_t size = (words %2) ? (words+1) * WORDSIZE : words * WORDSIZE;
-    
-    if(*(int32_t *)(blockPtr = mem_sbrk(size)) == -1){
-       
-        return NULL;
-    
-    }
-    
-    //previous epilogue removed
-    prevPtr = block_prev(blockPtr);
-    
-    block_setValAtPtr(&prevPtr[0],block_pack((size/WORDSIZE), FREE));
-    
-    blockPtr = prevPtr;
-
-    // Initialize free block header footer and epilogue
-    block_setValAtPtr(&blockPtr[block_size(blockPtr) - 1], block_pack(size/WORDSIZE, FREE)); //free
-    
-    //block footer
-    nextBlock = block_next(blockPtr);
-    
-    //Set epilogue block with no size as Allocated in the last block
-    block_setValAtPtr(&nextBlock[0], block_pack(0,ALLOCATED));
-    
-    //if previous block was free coalesce
-    result = (uint32_t *)coalesce(blockPtr);
-    
-    return result;
+    }
 
-}
+    else{
 
+        grown_map[bit / 8] &= (uint8_t)~mask;
 
+    }
+#endif
 
-static void *coalesce (void *blockPt){
-    
-    REQUIRES(blockPt!=NULL);
-    
-    dbg_printf("\nCOAL \n");
-    
-    uint32_t * blockPtr = (uint32_t*)blockPt;
-    uint32_t isPreviousFree = block_free(block_prev((uint32_t *)blockPtr));
-    uint32_t isNextFree = block_free(block_next((uint32_t *)blockPtr));
-    uint32_t size = block_size(blockPtr);
-    
-    if(!isPreviousFree && !isNextFree){
-    
-        return blockPtr;
-    
-    }
-    
-    else if(!isPreviousFree && isNextFree) {
-        
-        uint32_t *nextPtr  = block_next(blockPtr);
-        size = size + block_size(nextPtr);
-      
-        block_setValAtPtr(&blockPtr[0], block_pack(size, FREE));
-        block_setValAtPtr(&blockPtr[size-1], block_pack(size, FREE));
-        
-    }
-    
-    else if(isPreviousFree && !isNextFree){
-    
-        uint32_t *prevPtr  =   block_prev(blockPtr);
-        size = size + block_size(prevPtr);
-        
-        block_setValAtPtr(&prevPtr[0], block_pack(size, FREE));
-        block_setValAtPtr(&prevPtr[size-1], block_pack(size, FREE));
-        
-        blockPtr = prevPtr;
-    
-    }
-    
-    else if(isPreviousFree && isNextFree){
-        
-       uint32_t *prevPtr  =   block_prev(blockPtr);
-       uint32_t *nextPtr  = block_next(blockPtr);
-       uint32_t sizePrev = block_size(prevPtr);
-       uint32_t sizeNext = block_size(nextPtr);
-        
-       size += sizeNext+sizePrev;
-
-       block_setValAtPtr(&prevPtr[0], block_pack(size, FREE));
-       block_setValAtPtr(&nextPtr[size-1], FREE);
-        
-       blockPtr = prevPtr;
-        
-    }
-    
-    return blockPtr;
 }
 
+// Mark the given block as free(1)/alloced(0): a free block gets a footer,
+// and the next block's header learns the new state.
+static inline void block_mark(uint32_t* block, int free) {
 
-/*
- * Find fit
- */
+    REQUIRES(block != NULL);
 
+    REQUIRES(in_heap(block));
 
-void *find_fit(uint32_t size){
+    unsigned int size = block_size(block);
 
-    dbg_printf("\nfind fit \n");
-    
-    uint32_t wSize = size/WORDSIZE;
-    uint32_t *traverser = heap_listp+1;
-    uint32_t isFree = block_free(traverser);
-    uint32_t currentBlockSize = block_size(traverser);
-    
-    REQUIRES(traverser!=NULL);
-   
-    do {
+    if(free){
+
+        block_clearBits(block, ALLOCATEDBIT);
+        block[size - 1] = block_pack(size, FREE);
+
+    }
+
+    else{
+
+        block_setBits(block, ALLOCATEDBIT);
+
+    }
+
+    block_setPrevAllocated(block + size, !free);
+
+}
+
+
+// Return a pointer to the memory malloc should return
+static inline uint32_t* block_mem(uint32_t* const block) {
+
+    REQUIRES(block != NULL);
+
+    REQUIRES(in_heap(block));
+
+    REQUIRES(aligned(block + 1));
+
+    return block + 1;
+
+}
+
+
+// Return the header to the previous block, which must be free
+static inline uint32_t* block_prev(uint32_t* const block) {
+
+    REQUIRES(block != NULL);
+
+    REQUIRES(in_heap(block));
+
+    REQUIRES(!block_prevAllocated(block));
+
+    return block - block_size(block - 1);
+
+}
+
+
+// Return the header to the next block
+static inline uint32_t* block_next(uint32_t* const block) {
+
+    REQUIRES(block != NULL);
+
+    REQUIRES(in_heap(block));
+
+    return block + block_size(block);
+
+}
+
+
+//Read value at address
+static inline uint32_t block_getValAtPtr(uint32_t* const ptr ){
+
+    REQUIRES(ptr != NULL);
+
+    uint32_t value;
+
+    value = (*ptr);
+
+    return value;
+
+}
+
+
+//Write value to address
+static inline void block_setValAtPtr(uint32_t* const ptr, uint32_t value ){
+
+    REQUIRES(ptr != NULL);
+
+    *ptr = value;
+
+}
+
+
+//Generate header and footer content
+static inline uint32_t block_pack(uint32_t size,int allocated){
+
+    REQUIRES(allocated == 1 || allocated == 0);
+
+    REQUIRES(size % 2 == 0 && size / 2 <= SIZEMASK);
+
+    return ((uint32_t)allocated<<30) | (size >> 1);
+
+}
+
+
+// Write the header of an allocated block
+static inline void block_setAllocated(uint32_t* block, uint32_t size,
+                                      int prevAllocated){
+
+    block_setValAtPtr(&block[0], block_pack(size, ALLOCATED) |
+                      (prevAllocated ? PREVALLOCATEDBIT : 0));
+
+}
+
+
+// Write the header and footer of a free block
+static inline void block_setFree(uint32_t* block, uint32_t size,
+                                 int prevAllocated){
+
+    block_setValAtPtr(&block[0], block_pack(size, FREE) |
+                      (prevAllocated ? PREVALLOCATEDBIT : 0));
+    block_setValAtPtr(&block[size - 1], block_pack(size, FREE));
+
+}
+
+
+// Write the header of a block being allocated with the given size, keeping
+// its previous-allocated bit
+static inline void block_claim(uint32_t* block, uint32_t size){
+
+#ifdef CLASSLOCKS
+    uint32_t header = block_header(block);
+
+    while(!__atomic_compare_exchange_n(block, &header,
+                                       (header & PREVALLOCATEDBIT) |
+                                       block_pack(size, ALLOCATED), 1,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#else
+    block_setAllocated(block, size, block_prevAllocated(block));
+#endif
+
+}
+
+
+/*
+ *  Free List Functions
+ *  -------------------
+ *  Free blocks store the offsets (in doublewords from heap_base) of their
+ *  predecessor and successor in block[1] and block[2], which reaches
+ *  32 GiB of heap.  Headers sit one word past a doubleword, so offset 0
+ *  would be the prologue; it is never on a list and doubles as NULL.
+ */
+
+// Convert a block pointer to its free list offset
+static inline uint32_t block_offset(const uint32_t* block) {
+
+    return block == NULL ? 0 : (uint32_t)((block - arena->heap_base) >> 1);
+
+}
+
+// Convert a free list offset back to a block pointer
+static inline uint32_t* offset_block(uint32_t offset) {
+
+    return offset == 0 ? NULL : arena->heap_base + ((size_t)offset << 1) + 1;
+
+}
+
+// Return the predecessor of a free block in its list
+static inline uint32_t* block_predFree(const uint32_t* block) {
+
+    return offset_block(block[1]);
+
+}
+
+// Return the successor of a free block in its list
+static inline uint32_t* block_succFree(const uint32_t* block) {
+
+    return offset_block(block[2]);
+
+}
+
+#ifdef TLSF
+
+// Return the TLSF class of a block of the given size (in words): the
+// first level is the power of two below the size, the second level the
+// next TLSF_SL_LOG bits after the leading one
+static inline unsigned int size_class(uint32_t words) {
+
+    REQUIRES(words >= MINBLOCKWORDS);
+
+    uint32_t dwords = words / 2;
+
+    if(dwords < TLSF_SL_COUNT){
+
+        return dwords;
+
+    }
+
+    unsigned int logSize = 31 - __builtin_clz(dwords);
+    unsigned int fl = logSize - TLSF_SL_LOG + 1;
+    unsigned int sl = (dwords >> (logSize - TLSF_SL_LOG)) - TLSF_SL_COUNT;
+
+    return fl * TLSF_SL_COUNT + sl;
+
+}
+
+#else
+
+// Return the size class of a block of the given size (in words)
+static inline unsigned int size_class(uint32_t words) {
+
+    REQUIRES(words >= MINBLOCKWORDS);
+
+    if(words <= SEGLIST_SMALL_WORDS){
+
+        return (words - MINBLOCKWORDS) / 2;
+
+    }
+
+    //ceil(log2(words)) for words > 2^SEGLIST_LOG_SMALL
+    unsigned int logSize = 32 - __builtin_clz(words - 1);
+
+    return SEGLIST_SMALL_COUNT + logSize - SEGLIST_LOG_SMALL - 1;
+
+}
+
+#endif
+
+// Insert a free block into the list for its size class, at the front or
+// in address order depending on the placement policy
+static inline void list_insert(uint32_t* block) {
+
+    REQUIRES(block_free(block));
+
+    unsigned int index = size_class(block_size(block));
+    uint32_t offset = block_offset(block);
+    uint32_t* pred = NULL;
+    uint32_t* succ = offset_block(arena->seglist[index]);
+
+    if(placement.order == MM_ORDER_ADDRESS){
+
+        //Offsets grow with addresses, so compare them directly
+        while(succ != NULL && block_offset(succ) < offset){
+
+            pred = succ;
+            succ = block_succFree(succ);
+
+        }
+
+    }
+
+    block[1] = block_offset(pred);
+    block[2] = block_offset(succ);
+
+    if(pred != NULL){
+
+        pred[2] = offset;
+
+    }
+
+    else{
+
+        arena->seglist[index] = offset;
+
+    }
+
+    if(succ != NULL){
+
+        succ[1] = offset;
+
+    }
+
+#ifdef TLSF
+    arena->tlsf_flMap |= 1u << (index / TLSF_SL_COUNT);
+    arena->tlsf_slMap[index / TLSF_SL_COUNT] |= 1u << (index % TLSF_SL_COUNT);
+#endif
+
+#ifdef CLASSLOCKS
+    if(pred == NULL && succ == NULL){
+
+        __atomic_fetch_or(&arena->seglist_map, (uint64_t)1 << index,
+                          __ATOMIC_RELAXED);
+
+    }
+#endif
+
+}
+
+// Unlink a free block from the list for its size class
+static inline void list_remove(uint32_t* block) {
+
+    REQUIRES(block_free(block));
+
+    unsigned int index = size_class(block_size(block));
+    uint32_t* pred = block_predFree(block);
+    uint32_t* succ = block_succFree(block);
+
+    //Keep the next-fit rover off blocks that leave the list
+    if(arena->seglist_rover[index] == block_offset(block)){
+
+        arena->seglist_rover[index] = block[2];
+
+    }
+
+    if(pred != NULL){
+
+        pred[2] = block[2];
+
+    }
+
+    else{
+
+        arena->seglist[index] = block[2];
+
+    }
+
+    if(succ != NULL){
+
+        succ[1] = block[1];
+
+    }
+
+#ifdef TLSF
+    if(arena->seglist[index] == 0){
+
+        arena->tlsf_slMap[index / TLSF_SL_COUNT] &=
+            ~(1u << (index % TLSF_SL_COUNT));
+
+        if(arena->tlsf_slMap[index / TLSF_SL_COUNT] == 0){
+
+            arena->tlsf_flMap &= ~(1u << (index / TLSF_SL_COUNT));
+
+        }
+
+    }
+#endif
+
+#ifdef CLASSLOCKS
+    if(arena->seglist[index] == 0){
+
+        __atomic_fetch_and(&arena->seglist_map, ~((uint64_t)1 << index),
+                           __ATOMIC_RELAXED);
+
+    }
+#endif
+
+}
+
+
+/*
+ *  Malloc Implementation
+ *  ---------------------
+ *  The following functions deal with the user-facing malloc implementation.
+ */
+
+/*
+ * mm_set_policy - choose the placement policy used from the next mm_init.
+ * A good-fit search examines at most probes blocks once it holds a fit.
+ */
+void mm_set_policy(enum mm_fit fit, enum mm_order order, unsigned int probes) {
+
+    placement_request.fit = fit;
+    placement_request.order = order;
+    placement_request.probes = probes > 0 ? probes : 1;
+
+}
+
+/*
+ * Initialize: return -1 on error, 0 on success.
+ */
+int mm_init(void) {
+
+    unsigned int index;
+#ifdef ASYNCFREE
+    unsigned int ring;
+#endif
+
+    mmap_threshold = MMAP_THRESHOLD;
+    placement = placement_request;
+
+#ifdef TLSF
+    //Constant-time lists: always LIFO, and find_fit ignores the fit policy
+    placement.order = MM_ORDER_LIFO;
+#endif
+
+#ifdef SLAB
+    memset(slab_pageMap, 0, sizeof(slab_pageMap));
+#endif
+
+    //Marks lie only below the breaks the last heap reached, so clearing
+    //costs what that heap used rather than MAX_HEAP
+    for(index = 0; index < MM_ARENAS; index++){
+
+        if(arenas[index].heap_base != NULL){
+
+            size_t lo = block_grownBit(arenas[index].heap_base);
+            size_t hi = block_grownBit((uint32_t *)
+                                       ((char *)arenas[index].heap_base +
+                                        arenas[index].heap_size));
+
+            memset(&grown_map[lo / 8], 0, hi / 8 - lo / 8 + 1);
+
+        }
+
+    }
+
+#ifdef ARENAS
+    arena = &arenas[0];
+    arena->region = 0;
+    arena_count = 1;
+    arena_next = 0;
+    arena_exhausted = 0;
+#endif
+
+#ifdef THREADS
+    __atomic_add_fetch(&heap_generation, 1, __ATOMIC_RELEASE);
+#endif
+
+#ifdef RSEQ
+    memset(cpucaches, 0, sizeof(cpucaches));
+#endif
+
+#ifdef LOCKFREE
+    memset(lockfree_stacks, 0, sizeof(lockfree_stacks));
+#endif
+
+#ifdef ASYNCFREE
+    //Blocks still on the rings belong to the old heap
+    pthread_once(&freering_once, freering_start);
+
+    for(ring = 0; ring < FREERING_COUNT; ring++){
+
+        pthread_mutex_lock(&freerings[ring].lock);
+        __atomic_store_n(&freerings[ring].head,
+                         __atomic_load_n(&freerings[ring].tail,
+                                         __ATOMIC_ACQUIRE),
+                         __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&freerings[ring].lock);
+
+    }
+#endif
+
+    return heap_init();
+
+}
+
+
+/*
+ * heap_init - lay out an empty heap for the current arena at the start of
+ * its break.  Returns -1 on error, 0 on success.
+ */
+static int heap_init(void) {
+
+#ifdef CLASSLOCKS
+    unsigned int index;
+#endif
+
+    arena->heap_size = 0;
+
+    if((arena->heap_listp = heap_sbrk(4 * WORDSIZE)) == (void *) -1){
+
+        return -1;
+
+    }
+
+    arena->heap_base = arena->heap_listp;
+    arena->heap_chunk = CHUNKSIZE/WORDSIZE;
+    memset(arena->seglist, 0, sizeof(arena->seglist));
+    memset(arena->seglist_rover, 0, sizeof(arena->seglist_rover));
+
+#ifdef SLAB
+    memset(arena->slab_partial, 0, sizeof(arena->slab_partial));
+    memset(arena->slab_demand, 0, sizeof(arena->slab_demand));
+
+    //Runs are located by masking, so pages must line up with the heap
+    REQUIRES(align(arena->heap_base, SLAB_RUNSIZE) == arena->heap_base);
+#endif
+
+#ifdef TLSF
+    arena->tlsf_flMap = 0;
+    memset(arena->tlsf_slMap, 0, sizeof(arena->tlsf_slMap));
+#endif
+
+#ifdef ARENAS
+    arena->remote = NULL;
+#endif
+
+#ifdef QUICKLISTS
+    memset(arena->quicklist, 0, sizeof(arena->quicklist));
+    memset(arena->quicklist_count, 0, sizeof(arena->quicklist_count));
+    arena->quicklist_total = 0;
+#endif
+
+#ifdef CLASSLOCKS
+    arena->seglist_map = 0;
+    arena->unmerged = 0;
+
+    for(index = 0; index < SEGLIST_COUNT; index++){
+
+        pthread_mutex_init(&arena->seglist_lock[index], NULL);
+
+    }
+#endif
+
+    //Padding word, two word prologue block, epilogue header
+    block_setValAtPtr(arena->heap_listp, block_pack(0, ALLOCATED));
+    block_setAllocated(arena->heap_listp + 1, DOUBLEWORDSIZE/WORDSIZE, 1);
+    block_setValAtPtr(arena->heap_listp + 2 , block_pack(DOUBLEWORDSIZE/WORDSIZE, ALLOCATED));
+    block_setAllocated(arena->heap_listp + 3, 0, 1);
+    arena->heap_zero = arena->heap_listp + 4;
+
+    //heap_listp points at the prologue header
+    arena->heap_listp++;
+
+    if((uint32_t *)extend_heap(CHUNKSIZE/WORDSIZE) == NULL){
+
+        return -1;
+
+    }
+
+    return 0;
+
+}
+
+
+
+/*
+ * extend_heap - grow the heap by an even number of words, turning the old
+ * epilogue into the header of a new free block.  Memory no break reached
+ * before stays under the zero mark; otherwise the mark moves up to the
+ * new break.  Returns the (coalesced) free block, which is on its free
+ * list.
+ */
+static void *extend_heap(uint32_t words){
+
+    uint32_t *blockPtr;
+    int zeroed;
+
+    //For allocation of even number of words in a heap
+    size_t size = (words % 2) ? ((size_t)words + 1) * WORDSIZE :
+                                (size_t)words * WORDSIZE;
+
+    zeroed = mem_zeroed((char *)arena->heap_base + arena->heap_size, size);
+
+    if((blockPtr = heap_sbrk((intptr_t)size)) == (void *) -1){
+
+        return NULL;
+
+    }
+
+    //previous epilogue becomes the new block's header
+    blockPtr--;
+
+    block_setFree(blockPtr, (uint32_t)(size / WORDSIZE),
+                  block_prevAllocated(blockPtr));
+
+    //Set epilogue block with no size as Allocated in the last block
+    block_setAllocated(block_next(blockPtr), 0, 0);
+
+    if(!zeroed){
+
+        arena->heap_zero = block_next(blockPtr) + 1;
+
+    }
+
+    //if previous block was free coalesce
+    return coalesce(blockPtr);
+
+}
+
+
+/*
+ * heap_top - the free block at the top of the heap (the wilderness), or
+ * NULL if the last block is allocated
+ */
+static uint32_t *heap_top(void){
+
+    uint32_t *epilogue = (uint32_t *)((char *)arena->heap_base +
+                                      arena->heap_size) - 1;
+
+    return block_prevAllocated(epilogue) ? NULL : block_prev(epilogue);
+
+}
+
+
+/*
+ * heap_extend - grow the heap until its top block is a free block of at
+ * least words, by the current chunk or by what the wilderness lacks,
+ * whichever is larger, and ramp the chunk up.  Returns the top block, or
+ * NULL if memlib is out of memory.
+ */
+static uint32_t *heap_extend(uint32_t words){
+
+    uint32_t *top = heap_top();
+    uint32_t extendWords = words;
+
+    if(top != NULL){
+
+        if(block_size(top) >= words){
+
+            return top;
+
+        }
+
+        extendWords -= block_size(top);
+
+    }
+
+    if(extendWords < arena->heap_chunk){
+
+        extendWords = arena->heap_chunk;
+
+    }
+
+    if(arena->heap_chunk < HEAP_GROW_MAX/WORDSIZE &&
+       (size_t)arena->heap_chunk * WORDSIZE * HEAP_GROW_SHARE <
+       arena->heap_size){
+
+        arena->heap_chunk *= 2;
+
+    }
+
+    return extend_heap(extendWords);
+
+}
+
+
+
+/*
+ * heap_zeroSeam - clear what coalesce merged away at the boundary seam
+ * (the footer before it and the header and links after it) above the
+ * zero mark, where only the top block's own words may be set
+ */
+static inline void heap_zeroSeam(uint32_t *seam){
+
+    uint32_t *wordPtr = seam - 1;
+
+    if(wordPtr < arena->heap_zero){
+
+        wordPtr = arena->heap_zero;
+
+    }
+
+    while(wordPtr < seam + 3){
+
+        *wordPtr++ = 0;
+
+    }
+
+}
+
+// Move the zero mark up to end, as the allocated block before it may be
+// written
+static inline void heap_dirty(uint32_t *end){
+
+    if(end > arena->heap_zero){
+
+        arena->heap_zero = end;
+
+    }
+
+}
+
+
+/*
+ * coalesce - merge a free block that is not yet on any list with its free
+ * neighbours, insert the result into its free list and return it.
+ */
+static void *coalesce (void *blockPt){
+
+    REQUIRES(blockPt!=NULL);
+
+    uint32_t * blockPtr = (uint32_t*)blockPt;
+    uint32_t * nextPtr = block_next(blockPtr);
+    uint32_t isPreviousFree = !block_prevAllocated(blockPtr);
+    uint32_t isNextFree = block_free(nextPtr);
+    uint32_t size = block_size(blockPtr);
+
+    if(isNextFree){
+
+        list_remove(nextPtr);
+        size += block_size(nextPtr);
+        heap_zeroSeam(nextPtr);
+
+    }
+
+    if(isPreviousFree){
+
+        uint32_t * prevPtr = block_prev(blockPtr);
+
+        list_remove(prevPtr);
+        size += block_size(prevPtr);
+        heap_zeroSeam(blockPtr);
+        blockPtr = prevPtr;
+
+    }
+
+    //Free blocks are never adjacent, so whatever precedes the merged
+    //block is allocated
+    if(isPreviousFree || isNextFree){
+
+        block_setFree(blockPtr, size, 1);
+
+    }
+
+    list_insert(blockPtr);
+
+    return blockPtr;
+}
+
+
+#ifdef TLSF
+
+/*
+ * tlsf_search - the head of the first non-empty class at or above index,
+ * from the bitmaps, or NULL if there is none
+ */
+static uint32_t *tlsf_search(unsigned int index){
+
+    unsigned int fl = index / TLSF_SL_COUNT;
+    uint32_t slMap = arena->tlsf_slMap[fl] & (~0u << (index % TLSF_SL_COUNT));
+
+    if(slMap == 0){
+
+        uint32_t flMap = arena->tlsf_flMap & (~0u << (fl + 1));
+
+        if(flMap == 0){
+
+            return NULL;
+
+        }
+
+        fl = __builtin_ctz(flMap);
+        slMap = arena->tlsf_slMap[fl];
+
+    }
+
+    return offset_block(arena->seglist[fl * TLSF_SL_COUNT +
+                                       __builtin_ctz(slMap)]);
+
+}
+
+
+/*
+ * Find fit - round the request up to the next class boundary so that every
+ * block in the class found fits, then pick the first non-empty class at or
+ * above it from the bitmaps.  Constant time: a few find-first-set scans
+ * and no list walking.  The wilderness is only taken when nothing else
+ * fits, so it stays whole for requests no other block can serve.
+ */
+static uint32_t *find_fit(uint32_t words){
+
+    uint32_t dwords = words / 2;
+
+    if(dwords >= TLSF_SL_COUNT){
+
+        unsigned int logSize = 31 - __builtin_clz(dwords);
+
+        dwords += (1u << (logSize - TLSF_SL_LOG)) - 1;
+
+        if(dwords > SIZEMASK){
+
+            return NULL;
+
+        }
+
+    }
+
+    uint32_t *top = heap_top();
+    uint32_t *fit = tlsf_search(size_class(dwords * 2));
+
+    //Leave the wilderness for last: every block of its class and above
+    //fits too
+    if(fit != NULL && fit == top){
+
+        unsigned int index = size_class(block_size(top)) + 1;
+
+        if((fit = block_succFree(top)) == NULL && index < SEGLIST_COUNT){
+
+            fit = tlsf_search(index);
+
+        }
+
+        if(fit == NULL){
+
+            fit = top;
+
+        }
+
+    }
+
+    return fit;
+
+}
+
+#else
+
+/*
+ * list_search - look for a block of at least words other than skip in one
+ * size class according to the placement policy.  Returns NULL if the
+ * class has none.
+ */
+static uint32_t *list_search(unsigned int index, uint32_t words,
+                             const uint32_t *skip){
+
+    uint32_t *head = offset_block(arena->seglist[index]);
+    uint32_t *start;
+    uint32_t *traverser;
+    uint32_t *best = NULL;
+    unsigned int probes = 0;
+
+    switch(placement.fit){
+
+    case MM_FIT_NEXT:
+
+        //Scan from the rover to the end, then wrap around from the head
+        start = offset_block(arena->seglist_rover[index]);
+
+        if(start == NULL){
+
+            start = head;
+
+        }
+
+        traverser = start;
+
+        do {
+
+            if(block_size(traverser) >= words && traverser != skip){
+
+                arena->seglist_rover[index] = traverser[2];
+                return traverser;
+
+            }
+
+            traverser = block_succFree(traverser);
+
+            if(traverser == NULL){
+
+                traverser = head;
+
+            }
+
+        } while(traverser != start);
+
+        return NULL;
+
+    case MM_FIT_BEST:
+    case MM_FIT_GOOD:
+
+        for(traverser = head; traverser != NULL;
+            traverser = block_succFree(traverser)){
+
+            uint32_t size = block_size(traverser);
+
+            if(traverser == skip){
+
+                continue;
+
+            }
+
+            if(size >= words && (best == NULL || size < block_size(best))){
+
+                best = traverser;
+
+                if(size == words){
+
+                    break;
+
+                }
+
+            }
+
+            //Good-fit settles for the best fit within the probe budget
+            if(best != NULL && placement.fit == MM_FIT_GOOD &&
+               ++probes >= placement.probes){
+
+                break;
+
+            }
+
+        }
+
+        return best;
+
+    case MM_FIT_FIRST:
+    default:
+
+        for(traverser = head; traverser != NULL;
+            traverser = block_succFree(traverser)){
+
+            if(block_size(traverser) >= words && traverser != skip){
+
+                return traverser;
+
+            }
+
+        }
+
+        return NULL;
+
+    }
+
+}
+
+
+/*
+ * Find fit - search the request's size class, then any larger non-empty
+ * class, using the placement policy within each class.  The wilderness is
+ * only taken when nothing else fits, so it stays whole for requests no
+ * other block can serve.
+ */
+static uint32_t *find_fit(uint32_t words){
+
+    unsigned int index;
+    uint32_t *top = heap_top();
+    uint32_t *fit;
+
+    for(index = size_class(words); index < SEGLIST_COUNT; index++){
+
+        if(arena->seglist[index] != 0 &&
+           (fit = list_search(index, words, top)) != NULL){
+
+            return fit;
+
+        }
+
+    }
+
+    return top != NULL && block_size(top) >= words ? top : NULL;
+}
+
+#endif
+
+
+/*
+ * request_words - the block size (in words) that holds size bytes of
+ * payload: header plus payload rounded up to keep payloads 8-byte aligned.
+ * Returns 0 if the request is too large for a block.
+ */
+static uint32_t request_words(size_t size) {
+
+    size_t checkSize;
+
+    if(size > (size_t)MAXBLOCKWORDS * WORDSIZE - WORDSIZE){
+
+        return 0;
+
+    }
+
+    else if(size <= DOUBLEWORDSIZE + WORDSIZE){
+
+        checkSize = MINBLOCKWORDS * WORDSIZE;
+
+    }
+
+    else{
+
+        checkSize = DOUBLEWORDSIZE *
+                    ((size + WORDSIZE + (DOUBLEWORDSIZE-1))/DOUBLEWORDSIZE);
+
+    }
+
+    return (uint32_t)(checkSize/WORDSIZE);
+
+}
+
+
+#ifdef CLASSLOCKS
+
+/*
+ *  Size Class Lock Functions
+ *  -------------------------
+ *  With -DCLASSLOCKS malloc and free hold the heap lock shared and lock
+ *  just the size class whose list they touch, so threads working on
+ *  different classes run in parallel.  A block's header reads free exactly
+ *  when the block is on its class's list, and both change only under that
+ *  class's lock.  free coalesces like the other builds, taking each free
+ *  neighbour off its list with a try-lock on the neighbour's class (so it
+ *  never waits holding a lock), then pushes the merged block under its
+ *  own class's lock.  A neighbour whose class is busy is left where it is
+ *  and counted in unmerged.  When no list has a fit, malloc takes the heap
+ *  lock exclusively, merges those runs with heap_consolidate if there are
+ *  any, and only then extends the heap; that is the one step that shuts
+ *  out every other thread.
+ */
+
+#if SEGLIST_COUNT > 64
+#error "seglist_map needs a bit per size class"
+#endif
+
+// Merge every run of adjacent free blocks into one block; the heap lock
+// must be held exclusively.  Runs are found from their first block on the
+// free lists, so the walk is over the free blocks rather than the heap.
+static void heap_consolidate(void) {
+
+    unsigned int index;
+    uint32_t *blockPtr;
+
+    for(index = 0; index < SEGLIST_COUNT; index++){
+
+        blockPtr = offset_block(arena->seglist[index]);
+
+        while(blockPtr != NULL){
+
+            uint32_t *nextPtr = block_next(blockPtr);
+            uint32_t size = block_size(blockPtr);
+
+            if(!block_prevAllocated(blockPtr) || !block_free(nextPtr)){
+
+                blockPtr = block_succFree(blockPtr);
+                continue;
+
+            }
+
+            list_remove(blockPtr);
+
+            do{
+
+                list_remove(nextPtr);
+                size += block_size(nextPtr);
+                nextPtr += block_size(nextPtr);
+
+            }while(block_free(nextPtr));
+
+            block_setFree(blockPtr, size, 1);
+            list_insert(blockPtr);
+
+            //The merged block may have gone on this very list
+            blockPtr = offset_block(arena->seglist[index]);
+
+        }
+
+    }
+
+    __atomic_store_n(&arena->unmerged, 0, __ATOMIC_RELAXED);
+
+}
+
+// Make a block of size words free and put it on its list under the lock
+// of its class, clearing the next block's PREVALLOCATEDBIT last.  The
+// header keeps its own PREVALLOCATEDBIT, which the block before may be
+// changing under another class's lock.  A neighbour that is free anyway
+// is one a free could not merge, and is counted for heap_consolidate.
+static void class_publish(uint32_t *blockPtr, uint32_t size) {
+
+    unsigned int index = size_class(size);
+    uint32_t *nextPtr = blockPtr + size;
+    uint32_t header = block_header(blockPtr);
+
+    pthread_mutex_lock(&arena->seglist_lock[index]);
+
+    nextPtr[-1] = block_pack(size, FREE);
+
+    while(!__atomic_compare_exchange_n(blockPtr, &header,
+                                       (header & PREVALLOCATEDBIT) |
+                                       block_pack(size, FREE), 1,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    list_insert(blockPtr);
+    block_setPrevAllocated(nextPtr, 0);
+
+    //Each neighbour's owner updates the same header word as we do, so one
+    //of the two is sure to see the other free
+    if(!block_prevAllocated(blockPtr) || block_free(nextPtr)){
+
+        __atomic_add_fetch(&arena->unmerged, 1, __ATOMIC_RELAXED);
+
+    }
+
+    pthread_mutex_unlock(&arena->seglist_lock[index]);
+
+}
+
+// Take the free block of size words at blockPtr off its list so a free
+// can merge it, if its class can be locked without waiting and the block
+// is still there.  following is the block being freed when blockPtr was
+// found through its footer; it is checked again under the lock, since
+// until then the footer could be stale.  The block is marked allocated so
+// no other free merges it too.  Returns 0 if it was not taken.
+static int class_claim(uint32_t *blockPtr, uint32_t size,
+                       uint32_t *following) {
+
+    unsigned int index = size_class(size);
+    int taken = 0;
+
+    if(pthread_mutex_trylock(&arena->seglist_lock[index]) != 0){
+
+        return 0;
+
+    }
+
+    if((following == NULL || (!block_prevAllocated(following) &&
+                              following[-1] == block_pack(size, FREE))) &&
+       block_free(blockPtr) && block_size(blockPtr) == size){
+
+        list_remove(blockPtr);
+        block_setBits(blockPtr, ALLOCATEDBIT);
+        taken = 1;
+
+    }
+
+    pthread_mutex_unlock(&arena->seglist_lock[index]);
+
+    return taken;
+
+}
+
+// Take a block of at least words off the free lists and mark it
+// allocated, trying each class seglist_map shows to be non-empty.  Returns
+// NULL if none has a fit.
+static uint32_t *class_take(uint32_t words) {
+
+    unsigned int index = size_class(words);
+    uint64_t map = __atomic_load_n(&arena->seglist_map, __ATOMIC_RELAXED) &
+                   (~(uint64_t)0 << index);
+    uint32_t *fit = NULL;
+
+    while(map != 0 && fit == NULL){
+
+        index = __builtin_ctzll(map);
+        map &= map - 1;
+
+        pthread_mutex_lock(&arena->seglist_lock[index]);
+
+        if(arena->seglist[index] != 0 &&
+           (fit = list_search(index, words, NULL)) != NULL){
+
+            list_remove(fit);
+            block_mark(fit, 0);
+
+        }
+
+        pthread_mutex_unlock(&arena->seglist_lock[index]);
+
+    }
+
+    return fit;
+
+}
+
+// Allocate the first words of a block class_take returned, giving any
+// remainder large enough to be a block back to its list
+static void class_place(uint32_t *blockPtr, uint32_t words) {
+
+    uint32_t remainingBlocks = block_size(blockPtr) - words;
+
+    if(remainingBlocks < MINBLOCKWORDS){
+
+        return;
+
+    }
+
+    //Nothing else can reach the remainder until it is published
+    block_claim(blockPtr, words);
+    block_setAllocated(&blockPtr[words], remainingBlocks, 1);
+
+    class_publish(&blockPtr[words], remainingBlocks);
+
+}
+
+// Serve a request no list could by merging the free blocks, searching
+// again and extending the heap, with the heap to ourselves.  The heap lock
+// must be held shared, and is again on return.
+static uint32_t *heap_grow(uint32_t words) {
+
+    uint32_t *blockPtr;
+
+    heap_release();
+    heap_acquireExclusive();
+
+    if(arena->unmerged != 0){
+
+        heap_consolidate();
+
+    }
+
+    if((blockPtr = find_fit(words)) != NULL ||
+       (blockPtr = heap_extend(words)) != NULL){
+
+        block_place(blockPtr, words);
+
+    }
+
+    heap_release();
+    heap_acquire();
+
+    return blockPtr;
+
+}
+
+// Free an allocated block, merging it with whichever neighbours are free
+// and can be claimed.  The block after it always starts where it ends;
+// the block before is found through the footer, which class_claim checks.
+// A large block at the top of the heap is trimmed with the heap held
+// exclusively.
+static void class_free(uint32_t *blockPtr) {
+
+    uint32_t size = block_size(blockPtr);
+    uint32_t *nextPtr = blockPtr + size;
+    uint32_t neighbourSize = block_size(nextPtr);
+
+    if(block_free(nextPtr) &&
+       class_claim(nextPtr, neighbourSize, NULL)){
+
+        size += neighbourSize;
+
+    }
+
+    if(!block_prevAllocated(blockPtr)){
+
+        neighbourSize = block_size(blockPtr - 1);
+
+        if(neighbourSize >= MINBLOCKWORDS &&
+           neighbourSize <= (uint32_t)(blockPtr -
+                                       block_next(arena->heap_listp)) &&
+           class_claim(blockPtr - neighbourSize, neighbourSize, blockPtr)){
+
+            blockPtr -= neighbourSize;
+            size += neighbourSize;
+
+        }
+
+    }
+
+    class_publish(blockPtr, size);
+
+    if(blockPtr + size == (uint32_t *)((char *)arena->heap_base +
+                                       arena->heap_size) - 1 &&
+       (size_t)size * WORDSIZE >= TRIM_THRESHOLD){
+
+        heap_release();
+        heap_acquireExclusive();
+
+        if(arena->unmerged != 0){
+
+            heap_consolidate();
+
+        }
+
+        heap_trim(TRIM_PAD);
+        heap_release();
+        heap_acquire();
+
+    }
+
+}
+
+#endif
+
+
+#ifdef QUICKLISTS
+
+/*
+ *  Quick List Functions
+ *  --------------------
+ *  free parks small blocks on the quick list for their size instead of
+ *  coalescing them, and malloc hands them straight back out, so a size the
+ *  program keeps recycling never touches the free lists.  Parked blocks
+ *  look allocated to the rest of the heap.  A list that fills up, and all
+ *  of them when the free lists have no fit, are freed and coalesced in one
+ *  pass.  The heap lock must be held.
+ */
+
+// Pop a block of exactly words from its quick list, or return NULL
+static uint32_t *quicklist_pop(uint32_t words) {
+
+    unsigned int index = (words - MINBLOCKWORDS) / 2;
+    uint32_t *blockPtr;
+
+    if(words > QUICKLIST_MAX_WORDS ||
+       (blockPtr = offset_block(arena->quicklist[index])) == NULL){
+
+        return NULL;
+
+    }
+
+    arena->quicklist[index] = blockPtr[1];
+    arena->quicklist_count[index]--;
+    arena->quicklist_total--;
+
+    return blockPtr;
+
+}
+
+// Free and coalesce every block on one quick list
+static void quicklist_flush(unsigned int index) {
+
+    uint32_t *blockPtr = offset_block(arena->quicklist[index]);
+
+    while(blockPtr != NULL){
+
+        uint32_t *next = offset_block(blockPtr[1]);
+
+        block_mark(blockPtr, 1);
+        coalesce(blockPtr);
+        blockPtr = next;
+
+    }
+
+    arena->quicklist_total -= arena->quicklist_count[index];
+    arena->quicklist[index] = 0;
+    arena->quicklist_count[index] = 0;
+
+}
+
+// Flush every quick list.  Returns 0 if they were all empty.
+static int quicklist_flushAll(void) {
+
+    unsigned int index;
+
+    if(arena->quicklist_total == 0){
+
+        return 0;
+
+    }
+
+    for(index = 0; index < QUICKLIST_CLASSES; index++){
+
+        if(arena->quicklist_count[index] != 0){
+
+            quicklist_flush(index);
+
+        }
+
+    }
+
+    return 1;
+
+}
+
+// Park an allocated block on the quick list for its size, flushing the
+// list first if it is full.  Returns 0 if the block is too large.
+static int quicklist_push(uint32_t *blockPtr) {
+
+    uint32_t words = block_size(blockPtr);
+    unsigned int index = (words - MINBLOCKWORDS) / 2;
+
+    if(words > QUICKLIST_MAX_WORDS){
+
+        return 0;
+
+    }
+
+    if(arena->quicklist_count[index] == QUICKLIST_COUNT){
+
+        quicklist_flush(index);
+
+    }
+
+    blockPtr[1] = arena->quicklist[index];
+    arena->quicklist[index] = block_offset(blockPtr);
+    arena->quicklist_count[index]++;
+    arena->quicklist_total++;
+
+    return 1;
+
+}
+
+#endif
+
+
+/*
+ * heap_malloc - allocate from the shared heap; the heap lock must be held
+ */
+static void *heap_malloc(size_t size) {
+
+    uint32_t words;
+    uint32_t *blockPtr;
+
+    if(size == 0){
+        return NULL;
+    }
+
+    if(size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)){
+
+        return mapped_malloc(size);
+
+    }
+
+    words = request_words(size);
+
+#ifdef SLAB
+    if(size <= SLAB_MAX_SIZE && slab_ready(size)){
+
+        return slab_malloc(size);
+
+    }
+#endif
+
+#ifdef CLASSLOCKS
+    if((blockPtr = class_take(words)) != NULL){
+
+        class_place(blockPtr, words);
+
+    }
+
+    else if((blockPtr = heap_grow(words)) == NULL){
+
+        return NULL;
+
+    }
+
+    return block_mem(blockPtr);
+#else
+#ifdef QUICKLISTS
+    if((blockPtr = quicklist_pop(words)) != NULL){
+
+        return block_mem(blockPtr);
+
+    }
+#endif
+
+    //Search the free lists for a fit
+    blockPtr = find_fit(words);
+
+#ifdef QUICKLISTS
+    //Merge the quick lists into the free lists before growing the heap
+    if(blockPtr == NULL && quicklist_flushAll()){
+
+        blockPtr = find_fit(words);
+
+    }
+#endif
+
+    //If no fit found
+    if(blockPtr == NULL && (blockPtr = heap_extend(words)) == NULL){
+
+        return NULL;
+
+    }
+
+    block_place(blockPtr, words);
+
+#ifdef SLAB
+    slab_count(block_size(blockPtr), 1);
+#endif
+
+    return block_mem(blockPtr);
+#endif
+
+}
+
+/*
+ * block_place - allocate the first words of a listed free block, returning
+ * any remainder large enough to be a block to the free lists.
+ */
+static void block_place(uint32_t *blockPtr, uint32_t words){
+
+    uint32_t freeSize = block_size(blockPtr);
+    uint32_t remainingBlocks = freeSize - words;
+
+    REQUIRES(freeSize >= words);
+
+    list_remove(blockPtr);
+
+    if(remainingBlocks < MINBLOCKWORDS){
+
+        block_mark(blockPtr, 0);
+        heap_dirty(&blockPtr[freeSize]);
+        return;
+
+    }
+
+    //The block after the remainder already knows its predecessor is free
+    block_claim(blockPtr, words);
+    block_setFree(&blockPtr[words], remainingBlocks, 1);
+    heap_dirty(&blockPtr[words]);
+
+    list_insert(&blockPtr[words]);
+
+}
+
+
+#ifndef CLASSLOCKS
+
+/*
+ * block_carve - allocate n consecutive blocks of words from the front of a
+ * listed free block, storing their payloads in out.  The free block leaves
+ * its list once and any remainder goes back once; a remainder too small
+ * to be a block pads the last one.
+ */
+static void block_carve(uint32_t *blockPtr, uint32_t words, size_t n,
+                        void **out){
+
+    uint32_t remainingBlocks = block_size(blockPtr) - words * (uint32_t)n;
+    uint32_t *endPtr = &blockPtr[words * (uint32_t)n];
+    size_t index;
+
+    REQUIRES(n > 0 && block_size(blockPtr) >= words * (uint32_t)n);
+
+    list_remove(blockPtr);
+
+    if(remainingBlocks < MINBLOCKWORDS){
+
+        endPtr += remainingBlocks;
+
+    }
+
+    heap_dirty(endPtr);
+
+    for(index = 0; index < n; index++){
+
+        uint32_t *nextPtr = index + 1 < n ? &blockPtr[words] : endPtr;
+
+        //The first block keeps the free block's prev bit
+        if(index == 0){
+
+            block_claim(blockPtr, (uint32_t)(nextPtr - blockPtr));
+
+        }
+
+        else{
+
+            block_setAllocated(blockPtr, (uint32_t)(nextPtr - blockPtr), 1);
+
+        }
+
+        out[index] = block_mem(blockPtr);
+        blockPtr = nextPtr;
+
+    }
+
+    if(remainingBlocks < MINBLOCKWORDS){
+
+        block_setPrevAllocated(endPtr, 1);
+        return;
+
+    }
+
+    //The block after the remainder already knows its predecessor is free
+    block_setFree(endPtr, remainingBlocks, 1);
+    list_insert(endPtr);
+
+}
+
+#endif
+
+
+/*
+ * heap_mallocBatch - allocate n blocks of size bytes, carved from a single
+ * free region when one can hold them all; the heap lock must be held.
+ * Returns how many payloads were stored in out, which is less than n only
+ * when the heap is out of memory.
+ */
+static size_t heap_mallocBatch(size_t size, size_t n, void **out){
+
+    size_t index;
+#ifndef CLASSLOCKS
+    uint32_t words = request_words(size);
+    uint32_t *blockPtr;
+#endif
+
+    if(n == 0){
+
+        return 0;
+
+    }
+
+#ifndef CLASSLOCKS
+    //Mapped blocks, slab slots and batches too big for one block go one
+    //at a time
+    if(words != 0 && size < __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)
+#ifdef SLAB
+       && size > SLAB_MAX_SIZE
+#endif
+       && n <= MAXBLOCKWORDS / words &&
+       ((blockPtr = find_fit(words * (uint32_t)n)) != NULL ||
+        (blockPtr = heap_extend(words * (uint32_t)n)) != NULL)){
+
+        block_carve(blockPtr, words, n, out);
+        return n;
+
+    }
+#endif
+
+    for(index = 0; index < n; index++){
+
+        if((out[index] = heap_malloc(size)) == NULL){
+
+            break;
+
+        }
+
+    }
+
+    return index;
+
+}
+
+
+/*
+ * block_placeAligned - allocate a block of words whose payload starts
+ * offset bytes past an alignment-byte boundary.  Any leading slack is
+ * split off and returned to the free lists as a block of its own.
+ * Returns the block header, or NULL if the heap cannot grow.
+ */
+static uint32_t *block_placeAligned(uint32_t words, uint32_t alignment,
+                                    uint32_t offset){
+
+    //Room to slide the payload to a boundary and still leave a whole
+    //free block in front of it
+    uint32_t searchWords = words + alignment/WORDSIZE + MINBLOCKWORDS;
+    uint32_t *blockPtr;
+    uint32_t *mem;
+    uint32_t lead;
+
+    REQUIRES(alignment >= ALIGNMENT && (alignment & (alignment - 1)) == 0);
+
+    REQUIRES(offset % ALIGNMENT == 0 && offset < alignment);
+
+    if((blockPtr = find_fit(searchWords)) == NULL &&
+       (blockPtr = heap_extend(searchWords)) == NULL){
+
+        return NULL;
+
+    }
+
+    mem = (uint32_t *)((char *)align((char *)block_mem(blockPtr) - offset,
+                                     alignment) + offset);
+    lead = (uint32_t)(mem - 1 - blockPtr);
+
+    if(lead != 0 && lead < MINBLOCKWORDS){
+
+        mem += alignment/WORDSIZE;
+        lead += alignment/WORDSIZE;
+
+    }
+
+    if(lead != 0){
+
+        //The block was free, so its predecessor is allocated and the
+        //leading slack cannot need coalescing
+        uint32_t size = block_size(blockPtr);
+
+        list_remove(blockPtr);
+
+        block_setFree(blockPtr, lead, 1);
+        list_insert(blockPtr);
+
+        blockPtr += lead;
+
+        block_setFree(blockPtr, size - lead, 0);
+        list_insert(blockPtr);
+
+    }
+
+    block_place(blockPtr, words);
+
+    ENSURES(block_mem(blockPtr) == mem);
+
+    return blockPtr;
+
+}
+
+/*
+ * heap_memalign - allocate size bytes on an alignment-byte boundary, a
+ * power of two above ALIGNMENT, from the shared heap; the heap lock must
+ * be held.  Returns NULL if the heap cannot grow, or for an alignment
+ * that does not fit the 32 bits block_placeAligned takes.
+ */
+static void *heap_memalign(size_t alignment, size_t size){
+
+    uint32_t words = request_words(size);
+    uint32_t *blockPtr;
+
+    if(words == 0 || alignment > MAX_HEAP || alignment > UINT32_MAX){
+
+        return NULL;
+
+    }
+
+#ifdef CLASSLOCKS
+    //Splitting off the slack takes the lists to ourselves, merged so that
+    //the block in front of a free one is allocated
+    heap_release();
+    heap_acquireExclusive();
+
+    if(arena->unmerged != 0){
+
+        heap_consolidate();
+
+    }
+
+    blockPtr = block_placeAligned(words, (uint32_t)alignment, 0);
+
+    heap_release();
+    heap_acquire();
+#else
+    blockPtr = block_placeAligned(words, (uint32_t)alignment, 0);
+#endif
+
+    return blockPtr == NULL ? NULL : block_mem(blockPtr);
+
+}
+
+
+#ifdef SLAB
+
+/*
+ *  Slab Functions
+ *  --------------
+ *  A run is an allocated heap block of exactly SLAB_RUNSIZE bytes whose
+ *  header is the second word of a SLAB_RUNSIZE-aligned page, so one run
+ *  ends where the next may begin.  Its payload is a struct slab_run
+ *  header followed by slotCount slots of slotSize bytes within the page.
+ *  Bit i of used[] is set while slot i is handed out; bits past slotCount
+ *  are set once and never cleared.
+ *  Runs with free slots are on the slab_partial list of their class.
+ *  free recognises slab pointers from slab_pageMap and reaches the run
+ *  header by masking the pointer, so slots need no metadata of their own.
+ */
+
+// Return the page number of a heap address for slab_pageMap
+static inline size_t slab_page(const void *ptr) {
+
+    return (size_t)((const char *)ptr - (const char *)arenas[0].heap_base) /
+           SLAB_RUNSIZE;
+
+}
+
+// Return the run header for a run list offset, which is its page number.
+// Page 0 holds the prologue and is never a run, so 0 doubles as NULL.
+static inline struct slab_run *slab_run(uint32_t offset) {
+
+    return offset == 0 ? NULL :
+           (struct slab_run *)((char *)arenas[0].heap_base +
+                               (size_t)offset * SLAB_RUNSIZE + SLAB_RUNOFFSET);
+
+}
+
+// Return the header of the run that holds a slot
+static inline struct slab_run *slab_runOf(const void *ptr) {
+
+    return (struct slab_run *)(((uintptr_t)ptr &
+                                ~(uintptr_t)(SLAB_RUNSIZE - 1)) +
+                               SLAB_RUNOFFSET);
+
+}
+
+// Return whether ptr points into a slab run
+static inline int slab_owns(const void *ptr) {
+
+    size_t page = slab_page(ptr);
+
+    return (slab_pageMap[page / 8] >> (page % 8)) & 1;
+
+}
+
+// Push a run onto the front of its class's partial list
+static void slab_link(struct slab_run *run) {
+
+    uint32_t offset = (uint32_t)slab_page(run);
+    struct slab_run *head = slab_run(arena->slab_partial[run->sizeClass]);
+
+    run->prev = 0;
+    run->next = arena->slab_partial[run->sizeClass];
+
+    if(head != NULL){
+
+        head->prev = offset;
+
+    }
+
+    arena->slab_partial[run->sizeClass] = offset;
+
+}
+
+// Unlink a run from its class's partial list
+static void slab_unlink(struct slab_run *run) {
+
+    if(run->prev != 0){
+
+        slab_run(run->prev)->next = run->next;
+
+    }
+
+    else{
+
+        arena->slab_partial[run->sizeClass] = run->next;
+
+    }
+
+    if(run->next != 0){
+
+        slab_run(run->next)->prev = run->prev;
+
+    }
+
+}
+
+// Carve a new run for a size class out of the heap
+static struct slab_run *slab_newRun(unsigned int sizeClass) {
+
+    uint32_t *blockPtr;
+    struct slab_run *run;
+    unsigned int slot;
+
+    if((blockPtr = block_placeAligned(SLAB_RUNSIZE/WORDSIZE, SLAB_RUNSIZE,
+                                      SLAB_RUNOFFSET)) == NULL){
+
+        return NULL;
+
+    }
+
+    run = (struct slab_run *)block_mem(blockPtr);
+    run->slotSize = (sizeClass + 1) * ALIGNMENT;
+    run->slotCount = (SLAB_RUNSIZE - SLAB_RUNOFFSET -
+                      sizeof(struct slab_run)) / run->slotSize;
+    run->freeCount = run->slotCount;
+    run->sizeClass = sizeClass;
+
+    memset(run->used, 0, sizeof(run->used));
+
+    for(slot = run->slotCount; slot < SLAB_BITMAP_WORDS * 64; slot++){
+
+        run->used[slot / 64] |= (uint64_t)1 << (slot % 64);
+
+    }
+
+    size_t page = slab_page(run);
+    slab_pageMap[page / 8] |= 1 << (page % 8);
+
+    slab_link(run);
+
+    return run;
+
+}
+
+// Return whether a request of up to SLAB_MAX_SIZE bytes goes to a run
+static inline int slab_ready(size_t size) {
+
+    uint32_t words = request_words(size);
+
+    if(((size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1)) >=
+       (size_t)words * WORDSIZE){
+
+        return 0;
+
+    }
+
+    return (size_t)__atomic_load_n(&arena->slab_demand[(words -
+           MINBLOCKWORDS) / 2], __ATOMIC_RELAXED) * words * WORDSIZE >=
+           (size_t)SLAB_MIN_DEMAND * SLAB_RUNSIZE;
+
+}
+
+// Count a small heap block in or out of its size's demand
+static inline void slab_count(uint32_t words, int live) {
+
+    unsigned int index = (words - MINBLOCKWORDS) / 2;
+
+    if(index >= SLAB_CLASSES){
+
+        return;
+
+    }
+
+    //mm_good_size reads the counts without the arena lock
+    if(live){
+
+        __atomic_store_n(&arena->slab_demand[index],
+                         arena->slab_demand[index] + 1, __ATOMIC_RELAXED);
+
+    }
+
+    else if(arena->slab_demand[index] > 0){
+
+        __atomic_store_n(&arena->slab_demand[index],
+                         arena->slab_demand[index] - 1, __ATOMIC_RELAXED);
+
+    }
+
+}
+
+/*
+ * slab_malloc - hand out a slot from a run of the request's size class,
+ * starting a new run if no run of that class has a free slot.
+ */
+static void *slab_malloc(size_t size) {
+
+    unsigned int sizeClass = (size - 1) / ALIGNMENT;
+    struct slab_run *run = slab_run(arena->slab_partial[sizeClass]);
+    unsigned int word;
+
+    REQUIRES(size > 0 && size <= SLAB_MAX_SIZE);
+
+    if(run == NULL && (run = slab_newRun(sizeClass)) == NULL){
+
+        return NULL;
+
+    }
+
+    for(word = 0; ~run->used[word] == 0; word++){}
+
+    unsigned int bit = __builtin_ctzll(~run->used[word]);
+
+    run->used[word] |= (uint64_t)1 << bit;
+
+    if(--run->freeCount == 0){
+
+        slab_unlink(run);
+
+    }
+
+    return (char *)(run + 1) + (word * 64 + bit) * run->slotSize;
+
+}
+
+/*
+ * slab_free - release a slot.  A run that becomes empty goes back to the
+ * heap unless it is the only run of its class with free slots.
+ */
+static void slab_free(void *ptr) {
+
+    struct slab_run *run = slab_runOf(ptr);
+    unsigned int slot = ((char *)ptr - (char *)(run + 1)) / run->slotSize;
+
+    REQUIRES(slot < run->slotCount);
+
+    REQUIRES(run->used[slot / 64] & ((uint64_t)1 << (slot % 64)));
+
+    run->used[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+
+    if(run->freeCount++ == 0){
+
+        slab_link(run);
+
+    }
+
+    if(run->freeCount == run->slotCount &&
+       (run->prev != 0 || run->next != 0)){
+
+        uint32_t *blockPtr = (uint32_t *)run - 1;
+        size_t page = slab_page(run);
+
+        slab_unlink(run);
+        slab_pageMap[page / 8] &= ~(1 << (page % 8));
+
+        block_mark(blockPtr, 1);
+        coalesce(blockPtr);
+
+    }
+
+}
+
+
+#endif
+
+
+/*
+ *  Mapped Block Functions
+ *  ----------------------
+ *  A mapped block is a mem_map region whose payload follows MAPPEDHEADER
+ *  bytes in, or lead bytes further for memalign.  The two words before
+ *  the payload hold the length of the region in bytes and the lead.
+ */
+
+// Return whether ptr is a mapped block rather than part of the heap.
+// memlib reserves MAX_HEAP bytes up front, so mappings lie outside it.
+static inline int mapped_owns(const void *ptr) {
+
+    return (size_t)((const char *)ptr - (const char *)arenas[0].heap_base) >=
+           MAX_HEAP;
+
+}
+
+// Return the bytes a mapping for size bytes of payload spans, whole
+// pages with the header in front, or 0 if it cannot be that large
+static inline size_t mapped_length(size_t size) {
+
+    size_t pageSize = mem_pagesize();
+
+    if(size > SIZE_MAX - MAPPEDHEADER - pageSize){
+
+        return 0;
+
+    }
+
+    return (size + MAPPEDHEADER + pageSize - 1) & ~(pageSize - 1);
+
+}
+
+// Return where the mapping holding a mapped block starts
+static inline char *mapped_base(void *ptr) {
+
+    return (char *)ptr - MAPPEDHEADER - ((size_t *)ptr)[-1];
+
+}
+
+// Give a large request a mapping of its own
+static void *mapped_malloc(size_t size) {
+
+    return mapped_memalign(MAPPEDHEADER, size);
+
+}
+
+// Give a large request a mapping of its own with the payload on an
+// alignment-byte boundary, a power of two.  The mapping is alignment bytes
+// longer than it would be, and the payload slides up by the lead.
+static void *mapped_memalign(size_t alignment, size_t size) {
+
+    size_t length;
+    size_t lead;
+    char *lo;
+
+    if(size > SIZE_MAX - alignment ||
+       (length = mapped_length(size + alignment - MAPPEDHEADER)) == 0){
+
+        return NULL;
+
+    }
+
+#if defined(ARENAS) || defined(CLASSLOCKS)
+    pthread_mutex_lock(&mapped_lock);
+    lo = mem_map(length);
+    pthread_mutex_unlock(&mapped_lock);
+#else
+    lo = mem_map(length);
+#endif
+
+    if(lo == NULL){
+
+        return NULL;
+
+    }
+
+    lead = (size_t)align(lo + MAPPEDHEADER, alignment) -
+           (size_t)(lo + MAPPEDHEADER);
+    lo += lead;
+    ((size_t *)lo)[0] = length;
+    ((size_t *)lo)[1] = lead;
+
+    return lo + MAPPEDHEADER;
+
+}
+
+// Return the number of payload bytes in a mapped block
+static inline size_t mapped_size(void *ptr) {
+
+    return ((size_t *)ptr)[-2] - MAPPEDHEADER - ((size_t *)ptr)[-1];
+
+}
+
+// Unmap a mapped block
+static inline void mapped_free(void *ptr) {
+
+    size_t length = ((size_t *)ptr)[-2];
+
+#if defined(ARENAS) || defined(CLASSLOCKS)
+    pthread_mutex_lock(&mapped_lock);
+#endif
+
+    if(length > __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) &&
+       length <= MMAP_THRESHOLD_MAX){
+
+        __atomic_store_n(&mmap_threshold, length, __ATOMIC_RELAXED);
+
+    }
+
+    mem_unmap(mapped_base(ptr));
+
+#if defined(ARENAS) || defined(CLASSLOCKS)
+    pthread_mutex_unlock(&mapped_lock);
+#endif
+
+}
+
+// Resize a mapped block to hold size bytes.  mem_remap extends or moves
+// its pages, so none of the payload is copied; the lead stays in front.
+// Returns NULL, leaving the block as it was, if the mapping cannot be
+// resized.
+static void *mapped_realloc(void *ptr, size_t size) {
+
+    size_t lead = ((size_t *)ptr)[-1];
+    size_t length;
+    char *lo = mapped_base(ptr);
+
+    if(size > SIZE_MAX - lead || (length = mapped_length(size + lead)) == 0){
+
+        return NULL;
+
+    }
+
+    if(length == ((size_t *)ptr)[-2]){
+
+        return ptr;
+
+    }
+
+#if defined(ARENAS) || defined(CLASSLOCKS)
+    pthread_mutex_lock(&mapped_lock);
+    lo = mem_remap(lo, length);
+    pthread_mutex_unlock(&mapped_lock);
+#else
+    lo = mem_remap(lo, length);
+#endif
+
+    if(lo == NULL){
+
+        return NULL;
+
+    }
+
+    lo += lead;
+    ((size_t *)lo)[0] = length;
+
+    return lo + MAPPEDHEADER;
+
+}
+
+
+// Return the number of payload bytes available at ptr
+static size_t payload_size(void *ptr) {
+
+    if(mapped_owns(ptr)){
+
+        return mapped_size(ptr);
+
+    }
+
+#ifdef SLAB
+    if(slab_owns(ptr)){
+
+        return slab_runOf(ptr)->slotSize;
+
+    }
+#endif
+
+    //The payload is the block less its header
+    return (size_t)(block_size((uint32_t *)ptr - 1) - 1) * WORDSIZE;
+
+}
+
+
+#ifndef NDEBUG
+
+// Return whether ptr can be a block allocated for size bytes: its payload
+// holds them, and a heap block is short of the next size up that
+// block_place would have split
+static int payload_matches(void *ptr, size_t size) {
+
+    if(size == 0 || payload_size(ptr) < size){
+
+        return 0;
+
+    }
+
+    if(mapped_owns(ptr)){
+
+        return 1;
+
+    }
+
+#ifdef SLAB
+    if(slab_owns(ptr)){
+
+        return 1;
+
+    }
+#endif
+
+    //realloc's headroom is more than block_place would have kept, but
+    //never twice the request
+    return block_size((uint32_t *)ptr - 1) <
+           (block_grown((uint32_t *)ptr - 1) ? 2 : 1) * request_words(size) +
+           MINBLOCKWORDS;
+
+}
+
+#endif
+
+
+/*
+ * zero_fill - clear bytes at ptr.  Regions of CALLOC_STREAM_SIZE bytes or
+ * more are written around the cache with non-temporal stores, since
+ * pulling them in would only evict what the program is working on.
+ */
+static void zero_fill(void *ptr, size_t bytes){
+
+#ifdef __SSE2__
+    if(bytes >= CALLOC_STREAM_SIZE){
+
+        char *lo = align(ptr, 16);
+        char *hi = (char *)((uintptr_t)((char *)ptr + bytes) &
+                            ~(uintptr_t)15);
+        __m128i zero = _mm_setzero_si128();
+
+        memset(ptr, 0, (size_t)(lo - (char *)ptr));
+        memset(hi, 0, (size_t)((char *)ptr + bytes - hi));
+
+        for(; lo < hi; lo += 16){
+
+            _mm_stream_si128((__m128i *)lo, zero);
+
+        }
+
+        _mm_sfence();
+        return;
+
+    }
+#endif
+
+    memset(ptr, 0, bytes);
+
+}
+
+#ifndef CLASSLOCKS
+
+/*
+ * heap_calloc - allocate size bytes of zeroes from the shared heap; the
+ * heap lock must be held.  A fresh mapping reads as zero, and so does the
+ * part of a heap block above the zero mark, but for the links and footer
+ * it had while free.  The requests are too large for the slab tier and
+ * the quick lists.
+ */
+static void *heap_calloc(size_t size){
+
+    uint32_t words;
+    uint32_t *blockPtr;
+    char *zero;
+    char *footer;
+    char *ptr;
+
+    if(size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)){
+
+        return mapped_malloc(size);
+
+    }
+
+    if((words = request_words(size)) == 0){
+
+        return NULL;
+
+    }
+
+    blockPtr = find_fit(words);
+
+#ifdef QUICKLISTS
+    if(blockPtr == NULL && quicklist_flushAll()){
+
+        blockPtr = find_fit(words);
+
+    }
+#endif
+
+    if(blockPtr == NULL && (blockPtr = heap_extend(words)) == NULL){
+
+        return NULL;
+
+    }
+
+    //Read the mark once the heap has grown, before placing moves it
+    zero = (char *)arena->heap_zero;
+    footer = (char *)block_next(blockPtr) - WORDSIZE;
+    ptr = (char *)block_mem(blockPtr);
+
+    block_place(blockPtr, words);
+
+    if(zero < ptr + DOUBLEWORDSIZE){
+
+        zero = ptr + DOUBLEWORDSIZE;
+
+    }
+
+    if(zero > ptr + size){
+
+        zero = ptr + size;
+
+    }
+
+    zero_fill(ptr, (size_t)(zero - ptr));
+
+    //A footer past the payload now belongs to the remainder
+    if(footer >= zero && footer < ptr + size){
+
+        *(uint32_t *)footer = 0;
+
+    }
+
+    return ptr;
+
+}
+
+#endif
+
+
+/*
+ * heap_free - return a block to the shared heap; the heap lock must be held
+ */
+static void heap_free(void *pt) {
+
+    if(pt == NULL){
+
+        return;
+
+    }
+
+    if(mapped_owns(pt)){
+
+        mapped_free(pt);
+        return;
+
+    }
+
+#ifdef SLAB
+    if(slab_owns(pt)){
+
+        slab_free(pt);
+        return;
+
+    }
+#endif
+
+    uint32_t * ptr = (uint32_t*)pt - 1;
+
+    REQUIRES(!block_free(ptr));
+
+#ifdef SLAB
+    slab_count(block_size(ptr), 0);
+#endif
+
+    //Blocks a batch or another arena frees reach the heap without passing
+    //free_block
+    if(block_grown(ptr)){
+
+        block_setGrown(ptr, 0);
+
+    }
+
+#ifdef CLASSLOCKS
+    class_free(ptr);
+#else
+#ifdef QUICKLISTS
+    if(quicklist_push(ptr)){
+
+        return;
+
+    }
+#endif
+
+    block_mark(ptr, 1);
+    block_retire(ptr);
+#endif
+
+}
+
+
+#ifndef CLASSLOCKS
+
+/*
+ * block_retire - coalesce a block just made free and, when that reaches
+ * the top of the heap, end the allocation burst and trim a large top
+ */
+static void block_retire(uint32_t *blockPtr) {
+
+    blockPtr = coalesce(blockPtr);
+
+    if(block_size(block_next(blockPtr)) == 0){
+
+        arena->heap_chunk = CHUNKSIZE/WORDSIZE;
+
+        if((size_t)block_size(blockPtr) * WORDSIZE >= TRIM_THRESHOLD){
+
+            heap_trim(TRIM_PAD);
+
+        }
+
+    }
+
+}
+
+#endif
+
+
+/*
+ * heap_freeBatch - free n blocks of this arena sorted by address; the heap
+ * lock must be held.  A run of heap blocks that abut one another is made
+ * one free block and coalesced once.
+ */
+static void heap_freeBatch(void **ptrs, size_t n) {
+
+    size_t index = 0;
+
+    while(index < n){
+
+        void *ptr = ptrs[index++];
+#ifndef CLASSLOCKS
+        uint32_t *blockPtr = (uint32_t *)ptr - 1;
+        uint32_t size;
+#endif
+
+        if(ptr == NULL){
+
+            continue;
+
+        }
+
+#ifndef CLASSLOCKS
+        if(!mapped_owns(ptr) &&
+#ifdef SLAB
+           !slab_owns(ptr) &&
+#endif
+           index < n && ptrs[index] == block_mem(block_next(blockPtr))
+#ifdef SLAB
+           && !slab_owns(ptrs[index])
+#endif
+           ){
+
+            size = block_size(blockPtr);
+            block_setGrown(blockPtr, 0);
+#ifdef SLAB
+            slab_count(size, 0);
+#endif
+
+            //Every later block of the run starts where the last one ends
+            do{
+
+                block_setGrown(&blockPtr[size], 0);
+#ifdef SLAB
+                slab_count(block_size(&blockPtr[size]), 0);
+#endif
+                size += block_size(&blockPtr[size]);
+                index++;
+
+            }while(index < n && ptrs[index] == block_mem(&blockPtr[size])
+#ifdef SLAB
+                   && !slab_owns(ptrs[index])
+#endif
+                   );
+
+            block_setFree(blockPtr, size, block_prevAllocated(blockPtr));
+            block_setPrevAllocated(&blockPtr[size], 0);
+            block_retire(blockPtr);
+            continue;
+
+        }
+#endif
+
+        heap_free(ptr);
+
+    }
+
+}
+
+
+/*
+ * heap_trim - release free memory at the top of the heap, keeping at least
+ * pad bytes of it.  Returns 1 if the heap shrank, 0 otherwise.  The heap
+ * lock must be held.
+ */
+static int heap_trim(size_t pad) {
+
+    uint32_t *lastPtr = heap_top();
+    uint32_t size;
+    uint32_t keep;
+
+    if(lastPtr == NULL){
+
+        return 0;
+
+    }
+
+    size = block_size(lastPtr);
+
+    //Whatever stays behind must be a whole, even-sized block
+    if(pad == 0){
+
+        keep = 0;
+
+    }
+
+    else if(pad >= (size_t)size * WORDSIZE){
+
+        return 0;
+
+    }
+
+    else{
+
+        keep = ((uint32_t)pad + DOUBLEWORDSIZE - 1) / DOUBLEWORDSIZE * 2;
+        keep = keep < MINBLOCKWORDS ? MINBLOCKWORDS : keep;
+
+    }
+
+    if(size - keep < MINBLOCKWORDS){
+
+        return 0;
+
+    }
+
+    list_remove(lastPtr);
+
+    if(keep == 0){
+
+        //The free block's header becomes the new epilogue
+        block_setAllocated(lastPtr, 0, 1);
+
+    }
+
+    else{
+
+        block_setFree(lastPtr, keep, 1);
+        list_insert(lastPtr);
+        block_setAllocated(&lastPtr[keep], 0, 0);
+
+    }
+
+    heap_sbrk(-(intptr_t)((size_t)(size - keep) * WORDSIZE));
+    arena->heap_chunk = CHUNKSIZE/WORDSIZE;
+
+    return 1;
+
+}
+
+
+
+/*
+ *  Arena Functions
+ *  ---------------
+ *  With -DARENAS each thread allocates from its own arena, chosen
+ *  round-robin the first time it calls in after mm_init, so threads that
+ *  do not outnumber the arenas never contend for a lock.  A block freed by
+ *  a thread of another arena is pushed onto its owner's lock-free remote
+ *  list instead, and the owner frees everything on that list on its next
+ *  trip to the heap.
+ */
+
+#ifdef ARENAS
+
+// Set up the next arena in a region of its own; arena_lock must be held
+static int arena_create(void) {
+
+    struct arena *self = arena;
+    struct arena *created = &arenas[arena_count];
+    int result = -1;
+
+    if((created->region = mem_region_new(ARENA_REGION)) >= 0){
+
+        pthread_mutex_init(&created->lock, NULL);
+
+        arena = created;
+        result = heap_init();
+        arena = self;
+
+    }
+
+    //Arena k must live in region k, so stop at the first failure
+    if(result < 0){
+
+        arena_exhausted = 1;
+        return -1;
+
+    }
+
+    __atomic_store_n(&arena_count, arena_count + 1, __ATOMIC_RELEASE);
+
+    return 0;
+
+}
+
+// Pick the next arena round-robin, creating it if need be; threads fall
+// back to arena 0 once the reservation has no room for more regions
+static struct arena *arena_assign(void) {
+
+    unsigned int index = __atomic_fetch_add(&arena_next, 1, __ATOMIC_RELAXED) %
+                         MM_ARENAS;
+    struct arena *chosen = &arenas[0];
+
+    pthread_mutex_lock(&arena_lock);
+
+    while(arena_count <= index && !arena_exhausted && arena_create() == 0);
+
+    if(index < arena_count){
+
+        chosen = &arenas[index];
+
+    }
+
+    pthread_mutex_unlock(&arena_lock);
+
+    return chosen;
+
+}
+
+// Return the arena whose heap holds the heap block at ptr
+static inline struct arena *arena_owner(const void *ptr) {
+
+    size_t below = (size_t)((const char *)arenas[0].heap_base + MAX_HEAP -
+                            (const char *)ptr);
+    size_t index = (below - 1) / ARENA_REGION + 1;
+
+    return index < __atomic_load_n(&arena_count, __ATOMIC_ACQUIRE) ?
+           &arenas[index] : &arenas[0];
+
+}
+
+// Push a block onto the remote list of the arena that owns it
+static void arena_remoteFree(struct arena *owner, void *ptr) {
+
+    void *head = __atomic_load_n(&owner->remote, __ATOMIC_RELAXED);
+
+    do{
+
+        *(void **)ptr = head;
+
+    }while(!__atomic_compare_exchange_n(&owner->remote, &head, ptr, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+}
+
+#endif
+
+// Point the calling thread at its arena (a no-op without -DARENAS)
+static inline void arena_bind(void) {
+
+#ifdef ARENAS
+    unsigned int generation = __atomic_load_n(&heap_generation,
+                                              __ATOMIC_ACQUIRE);
+
+    if(arena_generation != generation){
+
+        arena = arena_assign();
+        arena_generation = generation;
+
+    }
+#endif
+
+}
+
+// Free the blocks other threads handed back to this arena; the heap lock
+// must be held
+static inline void arena_drain(void) {
+
+#ifdef ARENAS
+    void *ptr;
+
+    if(__atomic_load_n(&arena->remote, __ATOMIC_RELAXED) == NULL){
+
+        return;
+
+    }
+
+    ptr = __atomic_exchange_n(&arena->remote, NULL, __ATOMIC_ACQUIRE);
+
+    while(ptr != NULL){
+
+        void *next = *(void **)ptr;
+
+        heap_free(ptr);
+        ptr = next;
+
+    }
+#endif
+
+}
+
+// Return whether ptr is a heap block of another thread's arena
+static inline int arena_foreign(const void *ptr) {
+
+#ifdef ARENAS
+    return !mapped_owns(ptr) && arena_owner(ptr) != arena;
+#else
+    (void)ptr;
+    return 0;
+#endif
+
+}
+
+
+#if defined(THREADS) && !defined(RSEQ)
+
+/*
+ *  Thread Cache Functions
+ *  ----------------------
+ *  Each thread keeps a LIFO stack of freed heap blocks per exact block
+ *  size up to TCACHE_MAX_WORDS.  Cached blocks stay allocated as far as
+ *  the heap is concerned, so a malloc/free pair that hits the cache never
+ *  takes the heap lock.  An empty stack is refilled, and a full one
+ *  flushed, TCACHE_BATCH blocks at a time under a single lock hold; a
+ *  thread's cache is flushed when it exits.
+ */
+
+// Return the calling thread's cache, emptying it if mm_init has reset
+// the heap since it was filled
+static struct tcache *tcache_get(void) {
+
+    unsigned int generation = __atomic_load_n(&heap_generation,
+                                              __ATOMIC_ACQUIRE);
+
+    if(tcache.generation != generation){
+
+        //First use by this thread: have its cache flushed at exit
+        if(tcache.generation == 0){
+
+            pthread_setspecific(tcache_key, &tcache);
+
+        }
+
+        memset(tcache.head, 0, sizeof(tcache.head));
+        memset(tcache.count, 0, sizeof(tcache.count));
+        tcache.generation = generation;
+
+    }
+
+    return &tcache;
+
+}
+
+// Give count blocks from the top of a cache stack back to the heap
+static void tcache_flush(struct tcache *cache, unsigned int index,
+                         uint32_t count) {
+
+    heap_acquire();
+
+    while(count-- > 0 && cache->head[index] != NULL){
+
+        void *ptr = cache->head[index];
+
+        cache->head[index] = *(void **)ptr;
+        cache->count[index]--;
+        heap_free(ptr);
+
+    }
+
+    heap_release();
+
+}
+
+// Flush a thread's whole cache when the thread exits
+static void tcache_destroy(void *arg) {
+
+    struct tcache *cache = arg;
+    unsigned int index;
+
+    if(cache->generation != __atomic_load_n(&heap_generation,
+                                            __ATOMIC_ACQUIRE)){
+
+        return;
+
+    }
+
+    for(index = 0; index < TCACHE_CLASSES; index++){
+
+        tcache_flush(cache, index, cache->count[index]);
+
+    }
+
+}
+
+static void tcache_createKey(void) {
+
+    pthread_key_create(&tcache_key, tcache_destroy);
+
+}
+
+// Pop a block of the given size from the cache, refilling it from the
+// heap when it is empty.  Returns NULL if the heap is out of memory.
+static void *tcache_malloc(uint32_t words) {
+
+    struct tcache *cache = tcache_get();
+    unsigned int index = (words - MINBLOCKWORDS) / 2;
+    void *ptr;
+
+    if(cache->head[index] == NULL){
+
+        heap_acquire();
+        arena_drain();
+
+        while(cache->count[index] < TCACHE_BATCH &&
+              (ptr = heap_malloc((size_t)(words - 1) * WORDSIZE)) != NULL){
+
+            *(void **)ptr = cache->head[index];
+            cache->head[index] = ptr;
+            cache->count[index]++;
+
+        }
+
+        heap_release();
+
+        if(cache->head[index] == NULL){
+
+            return NULL;
+
+        }
+
+    }
+
+    ptr = cache->head[index];
+    cache->head[index] = *(void **)ptr;
+    cache->count[index]--;
+
+    return ptr;
+
+}
+
+// Push a heap block onto the cache, flushing part of the stack once it
+// holds TCACHE_COUNT blocks.  words is the block size if the caller knows
+// it and 0 otherwise.  Returns 0 if the block is not cacheable.
+static int tcache_free(void *ptr, uint32_t words) {
+
+    struct tcache *cache;
+    unsigned int index;
+
+    if(mapped_owns(ptr) || arena_foreign(ptr)){
+
+        return 0;
+
+    }
+
+#ifdef SLAB
+    if(slab_owns(ptr)){
+
+        return 0;
+
+    }
+#endif
+
+    if(words == 0){
+
+        words = block_size((uint32_t *)ptr - 1);
+
+    }
+
+    if(words > TCACHE_MAX_WORDS){
+
+        return 0;
+
+    }
+
+    cache = tcache_get();
+    index = (words - MINBLOCKWORDS) / 2;
+
+    *(void **)ptr = cache->head[index];
+    cache->head[index] = ptr;
+
+    if(++cache->count[index] > TCACHE_COUNT){
+
+        tcache_flush(cache, index, TCACHE_BATCH);
+
+    }
+
+    return 1;
+
+}
+
+#endif
+
+
+#ifdef RSEQ
+
+/*
+ *  CPU Cache Functions
+ *  -------------------
+ *  The thread cache stacks, kept per CPU instead of per thread so that
+ *  idle threads hold no blocks.  A push or pop is a Linux restartable
+ *  sequence: it checks that the thread is still on the CPU whose stack it
+ *  picked and ends in a single store, and if the thread is preempted,
+ *  migrated or signalled before that store the kernel restarts it at the
+ *  abort handler, so the fast path needs neither a lock nor an atomic
+ *  instruction.  When the C library has not registered rseq for the
+ *  thread every request takes the locked path.
+ */
+
+#define CPUCACHE_STR(x) CPUCACHE_XSTR(x)
+#define CPUCACHE_XSTR(x) #x
+
+//Publish the descriptor of the sequence from 1 to its commit at 2 with
+//its abort handler at 4, then check the CPU
+#define CPUCACHE_BEGIN \
+    ".pushsection __rseq_cs, \"aw\"\n\t" \
+    ".balign 32\n" \
+    "3:\n\t" \
+    ".long 0x0, 0x0\n\t" \
+    ".quad 1f, (2f - 1f), 4f\n\t" \
+    ".popsection\n\t" \
+    "leaq 3b(%%rip), %%rax\n\t" \
+    "movq %%rax, %[rseqCs]\n" \
+    "1:\n\t" \
+    "cmpl %[cpu], %[cpuId]\n\t" \
+    "jnz 4f\n\t"
+
+//The abort handler must follow the signature the thread registered
+#define CPUCACHE_END \
+    "2:\n\t" \
+    ".pushsection __rseq_failure, \"ax\"\n\t" \
+    ".byte 0x0f, 0xb9, 0x3d\n\t" \
+    ".long " CPUCACHE_STR(RSEQ_SIG) "\n" \
+    "4:\n\t" \
+    "jmp %l[aborted]\n\t" \
+    ".popsection\n\t"
+
+// Return the calling thread's rseq area and the CPU it is running on, or
+// NULL if the stacks of that CPU cannot be used
+static inline struct rseq *cpucache_rseq(uint32_t *cpu) {
+
+    struct rseq *rs;
+
+    if(__rseq_size == 0){
+
+        return NULL;
+
+    }
+
+    rs = (struct rseq *)((char *)__builtin_thread_pointer() + __rseq_offset);
+    *cpu = __atomic_load_n(&rs->cpu_id_start, __ATOMIC_RELAXED);
+
+    if((int32_t)__atomic_load_n(&rs->cpu_id, __ATOMIC_RELAXED) < 0 ||
+       *cpu >= CPUCACHE_CPUS){
+
+        return NULL;
+
+    }
+
+    return rs;
+
+}
+
+// Pop the top block of a stack of the given CPU into *ptr.  Returns
+// CPUCACHE_MISS if the stack is empty.
+static enum cpucache_status cpucache_pop(struct rseq *rs, uint32_t cpu,
+                                         unsigned int index, void **ptr) {
+
+    __asm__ __volatile__ goto (
+        CPUCACHE_BEGIN
+        "movq (%[head]), %%rax\n\t"
+        "testl %%eax, %%eax\n\t"
+        "jz %l[missed]\n\t"
+        "movl %%eax, %%ecx\n\t"
+        "leaq 8(%[base], %%rcx, 8), %%rcx\n\t"
+        "movq %%rcx, (%[ptr])\n\t"
+        "movq (%%rcx), %%rax\n\t"
+        "movq %%rax, (%[head])\n"
+        CPUCACHE_END
+        :
+        : [cpu] "r" (cpu), [cpuId] "m" (rs->cpu_id),
+          [rseqCs] "m" (rs->rseq_cs), [head] "r" (&cpucaches[cpu].head[index]),
+          [base] "r" (arenas[0].heap_base), [ptr] "r" (ptr)
+        : "rax", "rcx", "cc", "memory"
+        : missed, aborted);
+
+    return CPUCACHE_HIT;
+
+missed:
+    return CPUCACHE_MISS;
+
+aborted:
+    return CPUCACHE_ABORTED;
+
+}
+
+// Push a heap block onto a stack of the given CPU.  Returns CPUCACHE_MISS
+// if the stack already holds CPUCACHE_COUNT blocks.
+static enum cpucache_status cpucache_push(struct rseq *rs, uint32_t cpu,
+                                          unsigned int index, void *ptr) {
+
+    uint64_t offset = block_offset((uint32_t *)ptr - 1);
+
+    __asm__ __volatile__ goto (
+        CPUCACHE_BEGIN
+        "movq (%[head]), %%rax\n\t"
+        "movq %%rax, %%rcx\n\t"
+        "shrq $32, %%rcx\n\t"
+        "cmpl %[limit], %%ecx\n\t"
+        "jae %l[missed]\n\t"
+        "movq %%rax, (%[ptr])\n\t"
+        "incq %%rcx\n\t"
+        "shlq $32, %%rcx\n\t"
+        "orq %[offset], %%rcx\n\t"
+        "movq %%rcx, (%[head])\n"
+        CPUCACHE_END
+        :
+        : [cpu] "r" (cpu), [cpuId] "m" (rs->cpu_id),
+          [rseqCs] "m" (rs->rseq_cs), [head] "r" (&cpucaches[cpu].head[index]),
+          [ptr] "r" (ptr), [offset] "r" (offset), [limit] "i" (CPUCACHE_COUNT)
+        : "rax", "rcx", "cc", "memory"
+        : missed, aborted);
+
+    return CPUCACHE_HIT;
+
+missed:
+    return CPUCACHE_MISS;
+
+aborted:
+    return CPUCACHE_ABORTED;
+
+}
+
+// Pop a block of the given size from this CPU's cache.  An empty stack is
+// refilled with up to TCACHE_BATCH blocks under the heap lock.  Returns
+// NULL if the heap is out of memory.
+static void *cpucache_malloc(uint32_t words) {
+
+    unsigned int index = (words - MINBLOCKWORDS) / 2;
+    size_t size = (size_t)(words - 1) * WORDSIZE;
+    enum cpucache_status status = CPUCACHE_MISS;
+    struct rseq *rs;
+    uint32_t cpu;
+    uint32_t count;
+    void *ptr;
+
+    while((rs = cpucache_rseq(&cpu)) != NULL &&
+          (status = cpucache_pop(rs, cpu, index, &ptr)) == CPUCACHE_ABORTED);
+
+    if(status == CPUCACHE_HIT){
+
+        return ptr;
+
+    }
+
+    heap_acquire();
+
+    if((ptr = heap_malloc(size)) != NULL){
+
+        for(count = 1; count < TCACHE_BATCH; count++){
+
+            void *spare = NULL;
+
+            while((rs = cpucache_rseq(&cpu)) != NULL &&
+                  (spare != NULL || (spare = heap_malloc(size)) != NULL) &&
+                  (status = cpucache_push(rs, cpu, index, spare)) ==
+                  CPUCACHE_ABORTED);
+
+            if(rs == NULL || spare == NULL || status != CPUCACHE_HIT){
+
+                heap_free(spare);
+                break;
+
+            }
+
+        }
+
+    }
+
+    heap_release();
+
+    return ptr;
+
+}
+
+// Push a heap block onto this CPU's cache.  words is the block size if
+// the caller knows it and 0 otherwise.  Returns 0 if the block is not
+// cacheable or the stack is full.
+static int cpucache_free(void *ptr, uint32_t words) {
+
+    enum cpucache_status status = CPUCACHE_MISS;
+    struct rseq *rs;
+    uint32_t cpu;
+
+    if(mapped_owns(ptr)){
+
+        return 0;
+
+    }
+
+#ifdef SLAB
+    if(slab_owns(ptr)){
+
+        return 0;
+
+    }
+#endif
+
+    if(words == 0){
+
+        words = block_size((uint32_t *)ptr - 1);
+
+    }
+
+    if(words > TCACHE_MAX_WORDS){
+
+        return 0;
+
+    }
+
+    while((rs = cpucache_rseq(&cpu)) != NULL &&
+          (status = cpucache_push(rs, cpu, (words - MINBLOCKWORDS) / 2,
+                                  ptr)) == CPUCACHE_ABORTED);
+
+    return status == CPUCACHE_HIT;
+
+}
+
+#endif
+
+
+#ifdef LOCKFREE
+
+/*
+ *  Lock-Free Stack Functions
+ *  -------------------------
+ *  Treiber stacks of heap blocks, one per block size up to
+ *  LOCKFREE_MAX_WORDS, shared by all threads.  Stacked blocks stay
+ *  allocated as far as the heap is concerned.  A pop reads the link of the
+ *  top block before swapping it out of the head, and that block may be
+ *  popped, used and pushed back in between; every push bumps the tag
+ *  beside the offset, so such a stale swap fails and retries (ABA).  A
+ *  32-bit tag only wraps after 2^32 pushes in the window of one pop.
+ *  Memory on the stacks is not returned to the heap.
+ */
+
+// Push a chain of blocks, linked first to last, onto a stack
+static void lockfree_push(struct lockfree_stack *stack, uint32_t *first,
+                          uint32_t *last) {
+
+    uint64_t head = __atomic_load_n(&stack->head, __ATOMIC_RELAXED);
+    uint64_t top;
+
+    do{
+
+        __atomic_store_n(&last[1], (uint32_t)head, __ATOMIC_RELAXED);
+        top = (((head >> 32) + 1) << 32) | block_offset(first);
+
+    }while(!__atomic_compare_exchange_n(&stack->head, &head, top, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+}
+
+// Pop the top block of a stack, or return NULL if it is empty
+static uint32_t *lockfree_pop(struct lockfree_stack *stack) {
+
+    uint64_t head = __atomic_load_n(&stack->head, __ATOMIC_ACQUIRE);
+    uint64_t next;
+    uint32_t *blockPtr;
+
+    do{
+
+        if((uint32_t)head == 0){
+
+            return NULL;
+
+        }
+
+        //The heap never unmaps, so the link is readable even if the
+        //block has been taken meanwhile; the tag then fails the swap
+        blockPtr = offset_block((uint32_t)head);
+        next = (head & ~(uint64_t)UINT32_MAX) |
+               __atomic_load_n(&blockPtr[1], __ATOMIC_RELAXED);
+
+    }while(!__atomic_compare_exchange_n(&stack->head, &head, next, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+    return blockPtr;
+
+}
+
+// Pop a block of the given size.  An empty stack is refilled with a chain
+// of LOCKFREE_BATCH - 1 blocks taken under one heap lock hold and
+// published with one swap.  Returns NULL if the heap is out of memory.
+static void *lockfree_malloc(uint32_t words) {
+
+    struct lockfree_stack *stack =
+        &lockfree_stacks[(words - MINBLOCKWORDS) / 2];
+    size_t size = (size_t)(words - 1) * WORDSIZE;
+    uint32_t *first = NULL;
+    uint32_t *last = NULL;
+    uint32_t *blockPtr;
+    unsigned int count;
+    void *ptr;
+
+    if((blockPtr = lockfree_pop(stack)) != NULL){
+
+        return block_mem(blockPtr);
+
+    }
+
+    heap_acquire();
+
+    ptr = heap_malloc(size);
+
+    for(count = 1; ptr != NULL && count < LOCKFREE_BATCH; count++){
+
+        void *spare = heap_malloc(size);
+
+        if(spare == NULL){
+
+            break;
+
+        }
+
+        blockPtr = (uint32_t *)spare - 1;
+
+        if(last == NULL){
+
+            last = blockPtr;
+
+        }
+
+        else{
+
+            blockPtr[1] = block_offset(first);
+
+        }
+
+        first = blockPtr;
+
+    }
+
+    heap_release();
+
+    if(first != NULL){
+
+        lockfree_push(stack, first, last);
+
+    }
+
+    return ptr;
+
+}
+
+// Push a heap block onto the stack for its size.  words is the block size
+// if the caller knows it and 0 otherwise.  Returns 0 if the block is too
+// large or not a heap block.
+static int lockfree_free(void *ptr, uint32_t words) {
+
+    uint32_t *blockPtr = (uint32_t *)ptr - 1;
+
+    if(mapped_owns(ptr)){
+
+        return 0;
+
+    }
+
+    if(words == 0){
+
+        words = block_size(blockPtr);
+
+    }
+
+    if(words > LOCKFREE_MAX_WORDS){
+
+        return 0;
+
+    }
+
+    lockfree_push(&lockfree_stacks[(words - MINBLOCKWORDS) / 2], blockPtr,
+                  blockPtr);
+
+    return 1;
+
+}
+
+#endif
+
+
+#ifdef ASYNCFREE
+
+/*
+ *  Free Ring Functions
+ *  -------------------
+ *  free pushes heap blocks onto its thread's ring and returns without
+ *  touching the heap lock; the reclaimer thread drains the rings in
+ *  batches, so one lock hold pays for many frees.  Queued blocks stay
+ *  allocated as far as the heap is concerned.  A producer publishes with a
+ *  sequentially consistent store of tail and then reads freering_state,
+ *  while the reclaimer stores its state before a last look at the tails,
+ *  so one of the two always sees the other and no push sleeps unnoticed.
+ *  A full ring, or a thread beyond FREERING_COUNT, frees synchronously.
+ */
+
+// Return nonzero if any ring holds blocks
+static int freering_pending(void) {
+
+    unsigned int ring;
+
+    for(ring = 0; ring < FREERING_COUNT; ring++){
+
+        if(__atomic_load_n(&freerings[ring].tail, __ATOMIC_SEQ_CST) !=
+           __atomic_load_n(&freerings[ring].head, __ATOMIC_RELAXED)){
+
+            return 1;
+
+        }
+
+    }
+
+    return 0;
+
+}
+
+// Free up to limit blocks from a ring whose lock the caller holds, in one
+// heap lock hold.  Returns the number of blocks freed.
+static unsigned int freering_reap(struct freering *queue,
+                                  unsigned int limit) {
+
+    unsigned int head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    unsigned int count = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) -
+                         head;
+    unsigned int index;
+
+    if(count == 0){
+
+        return 0;
+
+    }
+
+    if(count > limit){
+
+        count = limit;
+
+    }
+
+    heap_acquire();
+
+    for(index = 0; index < count; index++){
+
+        heap_free(queue->slot[(head + index) % FREERING_SIZE]);
+
+    }
+
+    heap_release();
+
+    //Hand the slots back to the producer
+    __atomic_store_n(&queue->head, head + count, __ATOMIC_RELEASE);
+
+    return count;
+
+}
+
+// Free up to limit blocks from each ring.  Unless wait is set, rings
+// someone else is draining are skipped.  Returns the number of blocks
+// freed.
+static unsigned int freering_drain(unsigned int limit, int wait) {
+
+    unsigned int ring;
+    unsigned int drained = 0;
+
+    for(ring = 0; ring < FREERING_COUNT; ring++){
+
+        struct freering *queue = &freerings[ring];
+
+        if(wait){
+
+            pthread_mutex_lock(&queue->lock);
+
+        }
+
+        else if(pthread_mutex_trylock(&queue->lock) != 0){
+
+            continue;
+
+        }
+
+        drained += freering_reap(queue, limit);
+        pthread_mutex_unlock(&queue->lock);
+
+    }
+
+    return drained;
+
+}
+
+// Free the calling thread's own queued blocks, if it has any and the
+// reclaimer is not already on them
+static void freering_reapOwn(void) {
+
+    struct freering *queue = freering;
+
+    if(queue == NULL ||
+       __atomic_load_n(&queue->tail, __ATOMIC_RELAXED) ==
+       __atomic_load_n(&queue->head, __ATOMIC_RELAXED) ||
+       pthread_mutex_trylock(&queue->lock) != 0){
+
+        return;
+
+    }
+
+    freering_reap(queue, FREERING_SIZE);
+    pthread_mutex_unlock(&queue->lock);
+
+}
+
+// The reclaimer: drain while there is work, doze briefly when there is
+// none, and sleep until a push wakes it after a long quiet spell
+static void *freering_reclaim(void *arg) {
+
+    unsigned int dozes = 0;
+    struct timespec deadline;
+
+    (void)arg;
+
+    while(1){
+
+        if(freering_drain(FREERING_BATCH, 0) != 0){
+
+            dozes = 0;
+            continue;
+
+        }
+
+        pthread_mutex_lock(&freering_lock);
+
+        if(dozes < FREERING_DOZES){
+
+            __atomic_store_n(&freering_state, FREERING_DOZING,
+                             __ATOMIC_SEQ_CST);
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += FREERING_DOZE_NS;
+
+            if(deadline.tv_nsec >= 1000000000){
+
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+
+            }
+
+            if(!freering_pending()){
+
+                pthread_cond_timedwait(&freering_wake, &freering_lock,
+                                       &deadline);
+
+            }
+
+            dozes++;
+
+        }
+
+        else{
+
+            __atomic_store_n(&freering_state, FREERING_ASLEEP,
+                             __ATOMIC_SEQ_CST);
+
+            while(!freering_pending()){
+
+                pthread_cond_wait(&freering_wake, &freering_lock);
+
+            }
+
+            dozes = 0;
+
+        }
+
+        __atomic_store_n(&freering_state, FREERING_AWAKE, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&freering_lock);
+
+    }
+
+    return NULL;
+
+}
+
+static void freering_signal(void) {
+
+    pthread_mutex_lock(&freering_lock);
+    pthread_cond_signal(&freering_wake);
+    pthread_mutex_unlock(&freering_lock);
+
+}
+
+// Give a thread's ring back when the thread exits; the reclaimer still
+// drains whatever it left behind
+static void freering_release(void *arg) {
+
+    struct freering *queue = arg;
+
+    __atomic_store_n(&queue->inUse, 0, __ATOMIC_RELEASE);
+
+}
+
+static void freering_start(void) {
+
+    pthread_attr_t attr;
+    pthread_t reclaimer;
+    unsigned int ring;
+
+    for(ring = 0; ring < FREERING_COUNT; ring++){
+
+        pthread_mutex_init(&freerings[ring].lock, NULL);
+
+    }
+
+    pthread_key_create(&freering_key, freering_release);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    //Without a reclaimer every free stays synchronous
+    freering_running = pthread_create(&reclaimer, &attr, freering_reclaim,
+                                      NULL) == 0;
+
+    pthread_attr_destroy(&attr);
+
+}
+
+// Claim a free ring for the calling thread, or return NULL if all are
+// taken
+static struct freering *freering_claim(void) {
+
+    unsigned int ring;
+
+    for(ring = 0; ring < FREERING_COUNT; ring++){
+
+        int expected = 0;
+
+        if(__atomic_compare_exchange_n(&freerings[ring].inUse, &expected, 1,
+                                       0, __ATOMIC_ACQUIRE,
+                                       __ATOMIC_RELAXED)){
+
+            pthread_setspecific(freering_key, &freerings[ring]);
+
+            return &freerings[ring];
+
+        }
+
+    }
+
+    return NULL;
+
+}
+
+// Queue a block for the reclaimer.  Returns 0 if the caller has to free
+// it itself.
+static int freering_push(void *ptr) {
+
+    struct freering *queue;
+    unsigned int tail;
+    unsigned int fill;
+    enum freering_state state;
+
+    pthread_once(&freering_once, freering_start);
+
+    if(!freering_running){
+
+        return 0;
+
+    }
+
+    if(!freering_claimed){
+
+        freering = freering_claim();
+        freering_claimed = 1;
+
+    }
+
+    if((queue = freering) == NULL){
+
+        return 0;
+
+    }
+
+    tail = queue->tail;
+    fill = tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+    if(fill == FREERING_SIZE){
+
+        //Back-pressure: the reclaimer is behind, so help it out
+        freering_signal();
+        return 0;
+
+    }
+
+    queue->slot[tail % FREERING_SIZE] = ptr;
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    state = __atomic_load_n(&freering_state, __ATOMIC_SEQ_CST);
+
+    if(state == FREERING_ASLEEP ||
+       (state == FREERING_DOZING && fill + 1 == FREERING_BATCH)){
+
+        freering_signal();
+
+    }
+
+    return 1;
+
+}
+
+#endif
+
+
+/*
+ * malloc - serve small requests from the thread cache when there is one,
+ * and everything else from the shared heap under its lock
+ */
+void *malloc (size_t size) {
+
+    void *ptr;
+
+    if(size == 0){
+
+        return NULL;
+
+    }
+
+    arena_bind();
+
+#ifdef LOCKFREE
+    if(size <= LOCKFREE_MAX_SIZE){
+
+        return lockfree_malloc(request_words(size));
+
+    }
+#endif
+
+#ifdef RSEQ
+    if(size <= (TCACHE_MAX_WORDS - 1) * WORDSIZE
+#ifdef SLAB
+       && size > SLAB_MAX_SIZE
+#endif
+       ){
+
+        return cpucache_malloc(request_words(size));
+
+    }
+#elif defined(THREADS)
+    pthread_once(&tcache_once, tcache_createKey);
+
+    if(size <= (TCACHE_MAX_WORDS - 1) * WORDSIZE
+#ifdef SLAB
+       && size > SLAB_MAX_SIZE
+#endif
+       ){
+
+        return tcache_malloc(request_words(size));
+
+    }
+#endif
+
+#ifdef ASYNCFREE
+    freering_reapOwn();
+#endif
+
+    heap_acquire();
+    arena_drain();
+    ptr = heap_malloc(size);
+    heap_release();
+
+    return ptr;
+
+}
+
+
+/*
+ * free_block - cache the block, hand it back to the arena that owns it, or
+ * free it into the heap under the lock.  words is the block size if the
+ * caller knows it, which spares the caches a header load, and 0 otherwise.
+ */
+static void free_block(void *ptr, uint32_t words) {
+
+    arena_bind();
+
+    //The caches hand a block out again as it is, so it leaves its grown
+    //mark here; its headroom makes it larger than a size given to
+    //mm_free_sized says, so they file it by its header
+    if(!mapped_owns(ptr) && block_grown((uint32_t *)ptr - 1)){
+
+        block_setGrown((uint32_t *)ptr - 1, 0);
+        words = 0;
+
+    }
+
+#ifdef LOCKFREE
+    if(lockfree_free(ptr, words)){
+
+        return;
+
+    }
+#endif
+
+#ifdef RSEQ
+    if(cpucache_free(ptr, words)){
+
+        return;
+
+    }
+#elif defined(THREADS)
+    if(tcache_free(ptr, words)){
+
+        return;
+
+    }
+#else
+    (void)words;
+#endif
+
+#ifdef ARENAS
+    if(arena_foreign(ptr)){
+
+        arena_remoteFree(arena_owner(ptr), ptr);
+        return;
+
+    }
+#endif
+
+#ifdef ASYNCFREE
+    if(freering_push(ptr)){
+
+        return;
+
+    }
+#endif
+
+    heap_acquire();
+    heap_free(ptr);
+    heap_release();
+
+}
+
+
+/*
+ * free - free a block, finding its size in the header
+ */
+void free (void *ptr) {
+
+    if(ptr == NULL){
+
+        return;
+
+    }
+
+    free_block(ptr, 0);
+
+}
+
+
+/*
+ * mm_free_sized - free a block of size bytes.  A heap block is at least
+ * request_words(size) and smaller than one more block (block_place does
+ * not split off less), so the caches file it under that size without
+ * reading its header; a block larger than its class does no harm there.
+ * A block realloc has given headroom is the exception: grown_map says so
+ * without the header being read, and free_block files it by its header.
+ */
+void mm_free_sized(void *ptr, size_t size) {
+
+    if(ptr == NULL){
+
+        return;
+
+    }
+
+    REQUIRES(payload_matches(ptr, size));
+
+    free_block(ptr, request_words(size));
+
+}
+
+
+/*
+ * mm_usable_size - the payload bytes at ptr, all of which the caller may
+ * use: the whole heap block less its header, the slab slot or the rest of
+ * the mapping.  Returns 0 for NULL.
+ */
+size_t mm_usable_size(void *ptr) {
+
+    if(ptr == NULL){
+
+        return 0;
+
+    }
+
+    return payload_size(ptr);
+
+}
+
+
+/*
+ * mm_good_size - the payload malloc provides for size bytes, following
+ * the same tiers: mappings above the mmap threshold, slab slots and then
+ * heap blocks of request_words.  A heap block may come out larger still
+ * when block_place does not split off the rest.
+ */
+size_t mm_good_size(size_t size) {
+
+    uint32_t words;
+
+    if(size == 0){
+
+        return 0;
+
+    }
+
+    if(size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)){
+
+        return mapped_length(size) == 0 ? size :
+               mapped_length(size) - MAPPEDHEADER;
+
+    }
+
+#ifdef SLAB
+    arena_bind();
+
+    if(size <= SLAB_MAX_SIZE && slab_ready(size)){
+
+        return (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+
+    }
+#endif
+
+    if((words = request_words(size)) == 0){
+
+        return size;
+
+    }
+
+    return (size_t)(words - 1) * WORDSIZE;
+
+}
+
+
+/*
+ * mm_malloc_batch - allocate n objects of size bytes under one lock hold,
+ * carving them from a single free region when one can hold them all.
+ * Returns how many payloads were stored in out.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+
+    size_t count;
+
+    if(size == 0){
+
+        return 0;
+
+    }
+
+    arena_bind();
+    heap_acquire();
+    arena_drain();
+    count = heap_mallocBatch(size, n, out);
+    heap_release();
+
+    return count;
+
+}
+
+
+// Order pointers by address for mm_free_batch
+static int ptr_compare(const void *left, const void *right) {
+
+    uintptr_t a = (uintptr_t)*(void *const *)left;
+    uintptr_t b = (uintptr_t)*(void *const *)right;
+
+    return (a > b) - (a < b);
+
+}
+
+
+/*
+ * mm_free_batch - free n objects under one lock hold.  ptrs is sorted by
+ * address so that neighbouring blocks are merged in a single sweep.
+ */
+void mm_free_batch(void **ptrs, size_t n) {
+
+#ifdef ARENAS
+    size_t index;
+#endif
+
+    arena_bind();
+
+#ifdef ARENAS
+    //Blocks of other arenas go back to their owners
+    for(index = 0; index < n; index++){
+
+        if(ptrs[index] != NULL && arena_foreign(ptrs[index])){
+
+            arena_remoteFree(arena_owner(ptrs[index]), ptrs[index]);
+            ptrs[index] = NULL;
+
+        }
+
+    }
+#endif
+
+    qsort(ptrs, n, sizeof(*ptrs), ptr_compare);
+
+    heap_acquire();
+    arena_drain();
+    heap_freeBatch(ptrs, n);
+    heap_release();
+
+}
+
+
+/*
+ * mm_trim - release free memory at the top of the heap, keeping at least
+ * pad bytes of it.  Returns 1 if the heap shrank, 0 otherwise.
+ */
+int mm_trim(size_t pad) {
+
+    int trimmed;
+
+    arena_bind();
+    heap_acquireExclusive();
+
+#ifdef CLASSLOCKS
+    heap_consolidate();
+#endif
+
+#ifdef QUICKLISTS
+    quicklist_flushAll();
+#endif
+
+    trimmed = heap_trim(pad);
+    heap_release();
+
+    return trimmed;
+
+}
+
+
+/*
+ * mm_flush - free every block queued for the reclaimer so far
+ */
+void mm_flush(void) {
+
+#ifdef ASYNCFREE
+    freering_drain(FREERING_SIZE, 1);
+#endif
+
+}
+
+
+/*
+ * block_shrink - cut an allocated block down to words, handing a tail
+ * large enough to be a block back to the free lists.
+ */
+static void block_shrink(uint32_t *blockPtr, uint32_t words){
+
+    uint32_t size = block_size(blockPtr);
+
+    REQUIRES(!block_free(blockPtr) && size >= words);
+
+    if(size - words < MINBLOCKWORDS){
+
+        return;
+
+    }
+
+    block_claim(blockPtr, words);
+    block_setFree(&blockPtr[words], size - words, 1);
+    block_setPrevAllocated(&blockPtr[size], 0);
+
+    coalesce(&blockPtr[words]);
+
+}
+
+
+/*
+ * block_grow - try to extend an allocated block to words without moving
+ * it, by absorbing a free successor and, when that successor (or the
+ * block itself) ends the heap, by extending the heap.  Returns 0 if the
+ * block has to move.
+ */
+static int block_grow(uint32_t *blockPtr, uint32_t words){
+
+    uint32_t size = block_size(blockPtr);
+    uint32_t *nextPtr = block_next(blockPtr);
+    uint32_t available = size;
+
+    if(block_free(nextPtr)){
+
+        available += block_size(nextPtr);
+
+    }
+
+    if(available < words){
+
+        uint32_t *lastPtr = block_free(nextPtr) ? block_next(nextPtr) : nextPtr;
+        uint32_t extendWords = words - available;
+
+        if(extendWords < MINBLOCKWORDS){
+
+            extendWords = MINBLOCKWORDS;
+
+        }
+
+        //Only the wilderness can be grown on demand
+        if(block_size(lastPtr) != 0 || extend_heap(extendWords) == NULL){
+
+            return 0;
+
+        }
+
+    }
+
+    //extend_heap may have created or enlarged the free successor
+    nextPtr = block_next(blockPtr);
+    list_remove(nextPtr);
+    size += block_size(nextPtr);
+
+    block_claim(blockPtr, size);
+    block_setPrevAllocated(block_next(blockPtr), 1);
+
+    block_shrink(blockPtr, words);
+    heap_dirty(block_next(blockPtr));
+
+    return 1;
+
+}
+
+
+/*
+ * block_move - move the data of oldptr, whose payload is oldsize bytes, to a
+ * new block of size bytes and free the old one
+ */
+static void *block_move(void *oldptr, size_t oldsize, size_t size) {
+
+    void *newptr = malloc(size);
+
+    /* If realloc() fails the original block is left untouched  */
+    if(!newptr) {
+
+        return 0;
+
+    }
+
+    /* Copy the old data. */
+    if(size < oldsize) oldsize = size;
+    memcpy(newptr, oldptr, oldsize);
+
+    /* Free the old block. */
+    free(oldptr);
+
+    return newptr;
+
+}
+
+
+/*
+ * realloc - resize in place when the block can shrink, absorb a free
+ * successor or grow into the top of the heap, and remap a mapped block
+ * that stays large; otherwise move the data to a new block.  Heap blocks
+ * realloc has grown are marked in grown_map: one that has to move again
+ * gets geometric headroom, which it keeps until a realloc shrinks it well
+ * below that or heap_free takes it back.
+ */
+void *realloc(void *oldptr, size_t size) {
+
+    size_t oldsize;
+    uint32_t words;
+    uint32_t *blockPtr;
+    void *newptr;
+    size_t room = size;
+
+    /* If size == 0 then this is just free, and we return NULL. */
+    if(size == 0) {
+
+        free(oldptr);
+
+        return 0;
+
+    }
+
+    /* If oldptr is NULL, then this is just malloc. */
+    if(oldptr == NULL) {
+
+        return malloc(size);
+
+    }
+
+    arena_bind();
+
+    //Stay in the mapping while the block is still a large one; a shrink
+    //that cannot be remapped keeps the pages it has
+    if(mapped_owns(oldptr)){
+
+        oldsize = mapped_size(oldptr);
+
+        if(size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)){
+
+            if((newptr = mapped_realloc(oldptr, size)) != NULL){
+
+                return newptr;
+
+            }
+
+            if(size <= oldsize){
+
+                return oldptr;
+
+            }
+
+        }
+
+        return block_move(oldptr, oldsize, size);
+
+    }
+
+    //Another arena's block cannot be resized under this arena's lock
+    if(arena_foreign(oldptr)){
+
+        return block_move(oldptr, payload_size(oldptr), size);
+
+    }
+
+    heap_acquireExclusive();
+    oldsize = payload_size(oldptr);
+
+#ifdef SLAB
+    if(slab_owns(oldptr)){
+
+        //A slot cannot change size, but it may already be big enough
+        if(size <= oldsize && size > oldsize - ALIGNMENT){
+
+            heap_release();
+            return oldptr;
+
+        }
+
+    }
+
+    else
+#endif
+    if((words = request_words(size)) != 0){
+
+        blockPtr = (uint32_t *)oldptr - 1;
+
+        if(words <= block_size(blockPtr)){
+
+            //A grown block keeps its headroom for requests of at least the
+            //two thirds of it a move covers; smaller ones hand it back
+            if(!block_grown(blockPtr)){
+
+                block_shrink(blockPtr, words);
+
+            }
+
+            else if((size_t)words * 3 < (size_t)block_size(blockPtr) * 2){
+
+                block_shrink(blockPtr, words);
+                block_setGrown(blockPtr, 0);
+
+            }
+
+            heap_release();
+            return oldptr;
+
+        }
+
+        //A block that outgrows the threshold moves to a mapping of its
+        //own, where further growth is remapped rather than copied
+        if(size < __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) &&
+           block_grow(blockPtr, words)){
+
+            block_setGrown(blockPtr, 1);
+            heap_release();
+            return oldptr;
+
+        }
+
+        //A grown block that has to move again takes half its new size as
+        //headroom, so a block grown in small steps is copied O(log n) times
+        if(block_grown(blockPtr) &&
+           size + size / 2 < __atomic_load_n(&mmap_threshold,
+                                             __ATOMIC_RELAXED)){
+
+            room = size + size / 2;
+
+        }
+
+    }
+
+    heap_release();
+
+    newptr = block_move(oldptr, oldsize, room);
+
+    if(newptr != NULL && size > oldsize && !mapped_owns(newptr)
+#ifdef SLAB
+       && !slab_owns(newptr)
+#endif
+       ){
+
+        block_setGrown((uint32_t *)newptr - 1, 1);
+
+    }
+
+    return newptr;
 
-        /* the free size is calculated and substracted by 2
-         * to account for the header and footer and then
-         * compared with the requested size to check for a match
-         */
-        
-        if(isFree && wSize <= currentBlockSize - 2){
-            
-            return traverser;
-            
-        }
-        
-        traverser = block_next(traverser);
-        isFree = block_free(traverser);
-        currentBlockSize = block_size(traverser);
-        
-    }while(currentBlockSize!=0);
-    
-    return NULL;
 }
 
 
 /*
- * malloc
+ * calloc - allocate nmemb zeroed objects of size bytes.  Large requests
+ * take the heap lock for the whole call, so that heap_calloc can trust
+ * the zero mark; with -DCLASSLOCKS, where blocks freed under the shared
+ * lock may be taken before any merge, only fresh mappings skip the clear.
  */
-void *malloc (size_t size) {
-    
-    dbg_printf("\nMalloc \n");
-    
-    checkheap(1);  // Let's make sure the heap is ok!
-    
-    uint32_t usize = (uint32_t)size;
-    uint32_t checkSize;
-    uint32_t extendHeapSize;
-    uint32_t *blockPtr;
-    
-    if(size == 0){
+void *calloc (size_t nmemb, size_t size) {
+
+    size_t bytes;
+    void *newptr;
+
+    if(nmemb != 0 && size > SIZE_MAX / nmemb){
+
         return NULL;
+
     }
-    
-    else if(size<=DOUBLEWORDSIZE){
 
-        checkSize = DOUBLEWORDSIZE * 2;
-        
+    bytes = nmemb * size;
+
+#ifndef CLASSLOCKS
+    if(bytes > CALLOC_CLEAR_SIZE){
+
+        arena_bind();
+
+#ifdef ASYNCFREE
+        freering_reapOwn();
+#endif
+
+        heap_acquire();
+        arena_drain();
+        newptr = heap_calloc(bytes);
+        heap_release();
+
+        return newptr;
+
     }
-    else{
-        
-        checkSize = (DOUBLEWORDSIZE *((usize + (DOUBLEWORDSIZE) +(DOUBLEWORDSIZE-1))/DOUBLEWORDSIZE)) -8;
-        
-    }
-    
-    //Search the free list for a fit
-    if ((blockPtr = find_fit(checkSize))!=NULL) {
-        
-        block_place(blockPtr,(checkSize));
-        return (blockPtr+1);
-    
-    }
-    
-    //If no fit found
-    extendHeapSize = checkSize > CHUNKSIZE? checkSize : CHUNKSIZE;
-    
-    if((blockPtr = extend_heap(extendHeapSize/WORDSIZE)) == NULL){
-        
-        return NULL;
-        
+#endif
+
+    if((newptr = malloc(bytes)) != NULL && !mapped_owns(newptr)){
+
+        zero_fill(newptr, bytes);
+
     }
-    
-    /* The requsted size is added with 2(header & footer)
-     * and the sizes are set in them by using block_place 
-     * function
-     */
-    block_place(blockPtr,checkSize);
-    return (blockPtr+1);
-    
+
+    return newptr;
+
 }
 
-void block_place(uint32_t *blockPtr, uint32_t chkSize){
-    
-    dbg_printf("\nblock_place \n");
-    uint32_t freeSize = block_size(blockPtr);
-    uint32_t checkSize = chkSize/WORDSIZE;
-    
-    dbg_printf("\n Check Size %d\n", checkSize);
-    
-    block_setValAtPtr(&blockPtr[0], block_pack(checkSize+2, ALLOCATED));
-    block_setValAtPtr(&blockPtr[checkSize +1], block_pack(checkSize+2, ALLOCATED));
-    
-    uint32_t remainingBlocks = freeSize-(checkSize + 2);
-    
-    /* Never possible */
-    if((remainingBlocks)==1){
-        
-        block_setValAtPtr(&blockPtr[checkSize +2], block_pack(1, ALLOCATED));
-        
+
+/*
+ * memalign - allocate size bytes on an alignment-byte boundary, which must
+ * be a power of two.  Alignments malloc already gives are plain mallocs,
+ * and large blocks get mappings of their own (mapped_memalign); everything
+ * else is placed in the heap.
+ */
+void *memalign(size_t alignment, size_t size) {
+
+    void *ptr;
+
+    if(size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0){
+
+        return NULL;
+
     }
-    
-    else if((remainingBlocks) == 2){
-    
-        block_setValAtPtr(&blockPtr[checkSize +2], block_pack(1, ALLOCATED));
-        block_setValAtPtr(&blockPtr[checkSize +3], block_pack(1, ALLOCATED));
-        
+
+    if(alignment <= ALIGNMENT){
+
+        return malloc(size);
+
     }
-    
-    else if (remainingBlocks > 2){
-        
-        block_setValAtPtr(&blockPtr[checkSize +2], block_pack(remainingBlocks, FREE));
-        block_setValAtPtr(&blockPtr[freeSize - 1], block_pack(remainingBlocks, FREE));
-        
+
+    if(size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)){
+
+        return mapped_memalign(alignment, size);
+
     }
-    
+
+    arena_bind();
+
+#ifdef ASYNCFREE
+    freering_reapOwn();
+#endif
+
+    heap_acquire();
+    arena_drain();
+    ptr = heap_memalign(alignment, size);
+    heap_release();
+
+    return ptr;
+
 }
 
 
 /*
- * free
+ * aligned_alloc - the C11 spelling of memalign
  */
-void free (void *pt) {
-    
-    dbg_printf("\nFREE\n");
-    REQUIRES(pt!=NULL);
-    
-    uint32_t * ptr = (uint32_t*)pt;
-    ptr--;
-    
-    REQUIRES(ptr!=NULL);
-    
-    uint32_t size = block_size((uint32_t *)ptr);
-    
-    block_setValAtPtr(&ptr[0], block_pack(size, FREE));
-    block_setValAtPtr(&ptr[size - 1], block_pack(size, FREE));
-    
-    coalesce(ptr);
+void *aligned_alloc(size_t alignment, size_t size) {
 
-}
+    return memalign(alignment, size);
 
+}
 
 
 /*
- * realloc - you may want to look at mm-naive.c
+ * posix_memalign - memalign that stores the block in *memptr and reports
+ * failure as EINVAL for an alignment that is not a power-of-two multiple
+ * of sizeof(void *) and ENOMEM when out of memory
  */
-void *realloc(void *oldptr, size_t size) {
-    
-    dbg_printf("\nREALLOC\n");
-    
-    size_t oldsize;
-    
-    void *newptr;
-    
-    /* If size == 0 then this is just free, and we return NULL. */
-    if(size == 0) {
-    
-        free(oldptr);
-        
-        return 0;
-    
-    }
-    
-    /* If oldptr is NULL, then this is just malloc. */
-    if(oldptr == NULL) {
-    
-        return malloc(size);
-    
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+
+    void *ptr;
+
+    if(alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0){
+
+        return EINVAL;
+
     }
-    
-    newptr = malloc(size);
-    
-    /* If realloc() fails the original block is left untouched  */
-    if(!newptr) {
-    
+
+    if(size == 0){
+
+        *memptr = NULL;
         return 0;
-   
+
+    }
+
+    if((ptr = memalign(alignment, size)) == NULL){
+
+        return ENOMEM;
+
     }
-    
-    /* Copy the old data. */
-    oldsize = *SIZE_PTR(oldptr);
-    if(size < oldsize) oldsize = size;
-    memcpy(newptr, oldptr, oldsize);
-    
-    /* Free the old block. */
-    free(oldptr);
-    
-    return newptr;
+
+    *memptr = ptr;
+
+    return 0;
 
 }
 
 
 /*
- * calloc - you may want to look at mm-naive.c
+ * heap_check - walk the current arena's heap and free lists and verify the
+ * block invariants.  Returns the number of errors found.
  */
-void *calloc (size_t nmemb, size_t size) {
-   
-    dbg_printf("\nCalloc \n");
-    
-    size_t bytes = nmemb * size;
-    void *newptr;
-    
-    newptr = malloc(bytes);
-    memset(newptr, 0, bytes);
-    
-    return newptr;
+static int heap_check(int verbose) {
+
+    int errors = 0;
+    unsigned int heapFree = 0;
+    unsigned int listFree = 0;
+    unsigned int index;
+    uint32_t *blockPtr;
+    int prevFree = 0;
+#ifdef QUICKLISTS
+    unsigned int quickTotal = 0;
+#endif
+
+    heap_acquireExclusive();
+
+    if(block_size(arena->heap_listp) != 2 || block_free(arena->heap_listp)){
+
+        if(verbose) printf("checkheap: bad prologue\n");
+        errors++;
+
+    }
+
+    for(blockPtr = block_next(arena->heap_listp); block_size(blockPtr) != 0;
+        blockPtr = block_next(blockPtr)){
+
+        uint32_t size = block_size(blockPtr);
+
+        if(!aligned(block_mem(blockPtr)) || size < MINBLOCKWORDS || size % 2){
+
+            if(verbose) printf("checkheap: bad block %p size %u\n",
+                               (void *)blockPtr, size);
+            errors++;
+            break;
+
+        }
+
+        if(block_prevAllocated(blockPtr) == prevFree){
+
+            if(verbose) printf("checkheap: stale previous-allocated bit "
+                               "at %p\n", (void *)blockPtr);
+            errors++;
+
+        }
+
+        if(block_free(blockPtr) &&
+           blockPtr[size - 1] != block_pack(size, FREE)){
+
+            if(verbose) printf("checkheap: header/footer mismatch at %p\n",
+                               (void *)blockPtr);
+            errors++;
+
+        }
+
+        if(block_free(blockPtr) && block_grown(blockPtr)){
+
+            if(verbose) printf("checkheap: free block %p marked grown\n",
+                               (void *)blockPtr);
+            errors++;
+
+        }
+
+        if(block_free(blockPtr)){
+
+            heapFree++;
+
+            //With -DCLASSLOCKS a free may leave merging to heap_consolidate
+#ifndef CLASSLOCKS
+            if(prevFree){
+
+                if(verbose) printf("checkheap: uncoalesced block at %p\n",
+                                   (void *)blockPtr);
+                errors++;
+
+            }
+#endif
+
+        }
+
+        prevFree = block_free(blockPtr);
+
+    }
+
+    if((char *)blockPtr !=
+       (char *)arena->heap_base + arena->heap_size - WORDSIZE ||
+       block_free(blockPtr) || block_prevAllocated(blockPtr) == prevFree){
+
+        if(verbose) printf("checkheap: bad epilogue at %p\n", (void *)blockPtr);
+        errors++;
+
+    }
+
+    for(index = 0; index < SEGLIST_COUNT; index++){
+
+        uint32_t *pred = NULL;
+
+        for(blockPtr = offset_block(arena->seglist[index]); blockPtr != NULL;
+            blockPtr = block_succFree(blockPtr)){
+
+            listFree++;
+
+            if(!in_heap(blockPtr) || !block_free(blockPtr) ||
+               size_class(block_size(blockPtr)) != index ||
+               block_predFree(blockPtr) != pred ||
+               (placement.order == MM_ORDER_ADDRESS && pred != NULL &&
+                pred > blockPtr)){
+
+                if(verbose) printf("checkheap: bad list entry %p in class %u\n",
+                                   (void *)blockPtr, index);
+                errors++;
+                break;
+
+            }
+
+            pred = blockPtr;
+
+        }
+
+    }
+
+#ifdef TLSF
+    for(index = 0; index < SEGLIST_COUNT; index++){
+
+        unsigned int fl = index / TLSF_SL_COUNT;
+        int slBit = (arena->tlsf_slMap[fl] >> (index % TLSF_SL_COUNT)) & 1;
+        int flBit = (arena->tlsf_flMap >> fl) & 1;
+
+        if(slBit != (arena->seglist[index] != 0) ||
+           flBit != (arena->tlsf_slMap[fl] != 0)){
+
+            if(verbose) printf("checkheap: bitmap out of sync for class %u\n",
+                               index);
+            errors++;
+
+        }
+
+    }
+#endif
+
+#ifdef SLAB
+    for(index = 0; index < SLAB_CLASSES; index++){
+
+        struct slab_run *run;
+
+        for(run = slab_run(arena->slab_partial[index]); run != NULL;
+            run = slab_run(run->next)){
+
+            unsigned int used = 0;
+            unsigned int word;
+
+            for(word = 0; word < SLAB_BITMAP_WORDS; word++){
+
+                used += __builtin_popcountll(run->used[word]);
+
+            }
+
+            if(!slab_owns(run) || run->sizeClass != index ||
+               run->freeCount == 0 ||
+               used != SLAB_BITMAP_WORDS * 64u - run->freeCount){
+
+                if(verbose) printf("checkheap: bad slab run %p in class %u\n",
+                                   (void *)run, index);
+                errors++;
+                break;
+
+            }
+
+        }
+
+    }
+#endif
+
+#ifdef QUICKLISTS
+    for(index = 0; index < QUICKLIST_CLASSES; index++){
+
+        unsigned int count = 0;
+
+        for(blockPtr = offset_block(arena->quicklist[index]); blockPtr != NULL;
+            blockPtr = offset_block(blockPtr[1])){
+
+            if(!in_heap(blockPtr) || block_free(blockPtr) ||
+               block_size(blockPtr) != MINBLOCKWORDS + 2 * index ||
+               ++count > QUICKLIST_COUNT){
+
+                if(verbose) printf("checkheap: bad quick list entry %p\n",
+                                   (void *)blockPtr);
+                errors++;
+                break;
+
+            }
+
+        }
+
+        if(count != arena->quicklist_count[index]){
+
+            if(verbose) printf("checkheap: quick list %u holds %u blocks, "
+                               "not %u\n", index, count,
+                               arena->quicklist_count[index]);
+            errors++;
+
+        }
+
+        quickTotal += count;
+
+    }
+
+    if(quickTotal != arena->quicklist_total){
+
+        if(verbose) printf("checkheap: %u blocks on quick lists, not %u\n",
+                           quickTotal, arena->quicklist_total);
+        errors++;
+
+    }
+#endif
+
+    if(heapFree != listFree){
+
+        if(verbose) printf("checkheap: %u free blocks but %u listed\n",
+                           heapFree, listFree);
+        errors++;
+
+    }
+
+    heap_release();
+
+    return errors;
 
 }
 
 
-// Returns 0 if no errors were found, otherwise returns the error
+/*
+ * mm_checkheap - check every arena's heap.  Returns 0 if no errors were
+ * found, otherwise the number of errors.
+ */
 int mm_checkheap(int verbose) {
 
-    verbose = verbose;
-    return 0;
+#ifdef ARENAS
+    struct arena *self = arena;
+    unsigned int index;
+    int errors = 0;
+
+    for(index = 0; index < __atomic_load_n(&arena_count, __ATOMIC_ACQUIRE);
+        index++){
+
+        arena = &arenas[index];
+        errors += heap_check(verbose);
+
+    }
+
+    arena = self;
+
+    return errors;
+#else
+    return heap_check(verbose);
+#endif
 
 }
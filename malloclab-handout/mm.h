@@ -7,6 +7,9 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
 
 #else
 
@@ -15,11 +18,53 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t alignment, size_t size);
+extern void *aligned_alloc(size_t alignment, size_t size);
+extern int posix_memalign(void **memptr, size_t alignment, size_t size);
 
 #endif
 
 extern int mm_init(void);
 
+/* Give free memory at the top of the heap back, keeping pad bytes of it.
+   Returns 1 if the heap shrank. */
+extern int mm_trim(size_t pad);
+
+/* Finish every free handed to the background reclaimer so far.  Only
+   builds with -DASYNCFREE defer frees; elsewhere this does nothing. */
+extern void mm_flush(void);
+
+/* Allocate n objects of size bytes each into out, carved from one free
+   region where possible.  Returns how many were allocated, which is less
+   than n only when memory runs out. */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+
+/* Free n objects (NULLs allowed) at once.  ptrs is used as scratch space:
+   it is sorted by address so that neighbouring objects coalesce in one
+   sweep. */
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/* Free an object allocated with size bytes (its last realloc size), like
+   sized operator delete: the size picks the cache without a header read.
+   Debug builds check the size against the block. */
+extern void mm_free_sized(void *ptr, size_t size);
+
+/* Return how many bytes at ptr (0 for NULL) the caller may use, which can
+   be more than it asked for. */
+extern size_t mm_usable_size(void *ptr);
+
+/* Return the usable size malloc gives a request of size bytes, so that
+   growable containers can ask for capacities that fill their blocks. */
+extern size_t mm_good_size(size_t size);
+
+/* Free list placement policies.  mm_set_policy records the policy that the
+   next mm_init will use; probes bounds the search of MM_FIT_GOOD. */
+enum mm_fit { MM_FIT_FIRST, MM_FIT_NEXT, MM_FIT_BEST, MM_FIT_GOOD };
+enum mm_order { MM_ORDER_LIFO, MM_ORDER_ADDRESS };
+
+extern void mm_set_policy(enum mm_fit fit, enum mm_order order,
+                          unsigned int probes);
+
 /* This is largely for debugging.  You can do what you want with the
    verbose flag; we don't care. */
 extern int mm_checkheap(int verbose);